@@ -0,0 +1,146 @@
+// Run trivial sandboxed tasks with the previous task launching (fork a task process from the judge,
+//  which forks and execs a one-shot sandbox-exec) versus sending them to sandbox-exec workers
+// Requires root and an installed sandbox-exec
+// Usage: sandbox_exec_bench [tasks=1000] [parallel=4] [ballast_mib=0] [data_dir=TIOJ_DATA_DIR]
+//  ballast_mib: touch this much memory first to emulate a judge holding a large queue
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <tioj/paths.h>
+#include "sandbox_exec.h"
+#include "utils.h"
+
+namespace {
+
+SandboxOptions TrivialTask(const fs::path& boxdir, int uid) {
+  SandboxOptions opt;
+  opt.boxdir = boxdir;
+  opt.command = {"/bin/true"};
+  opt.workdir = "/";
+  opt.input = opt.output = opt.error = "/dev/null";
+  opt.uid = opt.gid = uid;
+  opt.wall_time = 1'000'000;
+  opt.rss = 65536;
+  opt.proc_num = 1;
+  opt.dirs = {"/usr", "/lib", "/lib64", "/bin", "/dev"};
+  opt.FilterDirs();
+  return opt;
+}
+
+namespace legacy {
+
+struct cjail_result SpawnExec(const SandboxOptions& opt) {
+  struct cjail_result ret = {};
+  int inpipe[2], outpipe[2];
+  if (pipe(inpipe) < 0 || pipe(outpipe) < 0) return ret;
+  pid_t pid = fork();
+  if (pid == 0) {
+    dup2(inpipe[1], 1);
+    dup2(outpipe[0], 0);
+    auto cmd = internal::kDataDir / "sandbox-exec";
+    execl(cmd.c_str(), cmd.c_str(), nullptr);
+    _exit(1);
+  }
+  close(inpipe[1]);
+  close(outpipe[0]);
+  auto vec = opt.Serialize();
+  long size = vec.size();
+  if (write(outpipe[1], &size, sizeof(size)) < 0 ||
+      write(outpipe[1], vec.data(), vec.size()) < 0 ||
+      read(inpipe[0], &ret, sizeof(ret)) < 0) {
+    ret.timekill = -1;
+  }
+  close(inpipe[0]);
+  close(outpipe[1]);
+  waitpid(pid, nullptr, 0);
+  return ret;
+}
+
+int Run(const fs::path& boxdir, int tasks, int parallel) {
+  int running = 0, errors = 0;
+  auto reap = [&]() {
+    int status;
+    wait(&status);
+    if (!WIFEXITED(status) || WEXITSTATUS(status)) errors++;
+    running--;
+  };
+  for (int i = 0; i < tasks; i++) {
+    if (running == parallel) reap();
+    int uid = 50000 + i % parallel;
+    if (fork() == 0) _exit(SpawnExec(TrivialTask(boxdir, uid)).timekill == -1);
+    running++;
+  }
+  while (running) reap();
+  return errors;
+}
+
+} // namespace legacy
+
+namespace worker {
+
+int Run(const fs::path& boxdir, int tasks, int parallel) {
+  std::vector<int> running;
+  int errors = 0;
+  auto reap = [&]() {
+    std::vector<struct pollfd> pfds;
+    for (int id : running) pfds.push_back({SandboxWorkerFd(id), POLLIN, 0});
+    poll(pfds.data(), pfds.size(), -1);
+    for (size_t i = pfds.size(); i--;) {
+      if (!pfds[i].revents) continue;
+      if (SandboxWorkerResult(running[i]).timekill == -1) errors++;
+      running.erase(running.begin() + i);
+    }
+  };
+  for (int i = 0; i < tasks; i++) {
+    while ((int)running.size() == parallel) reap();
+    int id = SandboxExecAsync(TrivialTask(boxdir, 50000 + i % parallel));
+    if (id < 0) {
+      errors++;
+      continue;
+    }
+    running.push_back(id);
+  }
+  while (running.size()) reap();
+  return errors;
+}
+
+} // namespace worker
+
+template <class Func>
+void Measure(const char* name, int tasks, Func&& func) {
+  using Clock = std::chrono::steady_clock;
+  auto start = Clock::now();
+  int errors = func();
+  double sec = std::chrono::duration<double>(Clock::now() - start).count();
+  printf("%-8s %.1f tasks/s", name, tasks / sec);
+  if (errors) printf(" (%d failed)", errors);
+  puts("");
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  int tasks = argc > 1 ? atoi(argv[1]) : 1000;
+  int parallel = argc > 2 ? atoi(argv[2]) : 4;
+  size_t ballast_size = argc > 3 ? atol(argv[3]) << 20 : 0;
+  if (argc > 4) internal::kDataDir = argv[4];
+  std::vector<char> ballast(ballast_size);
+  memset(ballast.data(), 1, ballast.size());
+
+  char tmpl[] = "/tmp/sandbox-bench-XXXXXX";
+  if (!mkdtemp(tmpl)) return 1;
+  fs::path boxdir = tmpl;
+  for (auto& i : TrivialTask(boxdir, 0).dirs) CreateDirs(boxdir / fs::path(i).relative_path());
+  for (int round = 0; round < 3; round++) {
+    Measure("legacy", tasks, [&]() { return legacy::Run(boxdir, tasks, parallel); });
+    Measure("worker", tasks, [&]() { return worker::Run(boxdir, tasks, parallel); });
+  }
+  RemoveAll(boxdir);
+}
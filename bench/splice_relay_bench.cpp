@@ -0,0 +1,124 @@
+// Pass a large input file through a program that copies stdin to stdout, relaying strict-mode
+//  stdin/stdout with the previous splicer processes (one per direction) versus the in-process
+//  relay thread of sandbox-exec
+// Usage: splice_relay_bench [size_mib=1024] [rounds=3] [dir=/tmp]
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sandbox.h"
+
+namespace {
+
+// stands for the sandboxed program; the input is read with plain read() as most solutions do
+pid_t CopyProgram(int in_fd, int out_fd) {
+  pid_t pid = fork();
+  if (pid != 0) return pid;
+  // the sandbox only keeps its stdin/stdout after exec
+  dup2(in_fd, 0);
+  dup2(out_fd, 1);
+  syscall(SYS_close_range, 2, ~0U, 0);
+  std::vector<char> buf(1 << 16);
+  ssize_t len;
+  while ((len = read(0, buf.data(), buf.size())) > 0) {
+    if (write(1, buf.data(), len) != len) _exit(1);
+  }
+  _exit(0);
+}
+
+namespace legacy {
+
+pid_t SpliceProcess(int read_fd, int write_fd, size_t max_size) {
+  pid_t pid = fork();
+  if (pid != 0) return pid;
+  while (max_size) {
+    auto ret = splice(read_fd, nullptr, write_fd, nullptr, std::min(max_size, (size_t)65536), 0);
+    if (ret <= 0) break;
+    max_size -= ret;
+  }
+  _exit(0);
+}
+
+void Run(int in_fd, int out_fd, size_t max_output) {
+  int pipes[2][2];
+  if (pipe2(pipes[0], O_CLOEXEC) < 0 || pipe2(pipes[1], O_CLOEXEC) < 0) exit(1);
+  pid_t pids[2] = {
+    SpliceProcess(in_fd, pipes[0][1], std::numeric_limits<size_t>::max()),
+    SpliceProcess(pipes[1][0], out_fd, max_output),
+  };
+  close(pipes[0][1]);
+  close(pipes[1][0]);
+  waitpid(CopyProgram(pipes[0][0], pipes[1][1]), nullptr, 0);
+  close(pipes[0][0]);
+  close(pipes[1][1]);
+  for (pid_t pid : pids) waitpid(pid, nullptr, 0);
+}
+
+} // namespace legacy
+
+namespace relay {
+
+void Run(int in_fd, int out_fd, size_t max_output) {
+  int pipes[2][2];
+  if (pipe2(pipes[0], O_CLOEXEC) < 0 || pipe2(pipes[1], O_CLOEXEC) < 0) exit(1);
+  std::thread relay(SpliceRelay, in_fd, pipes[0][1], pipes[1][0], out_fd, max_output);
+  waitpid(CopyProgram(pipes[0][0], pipes[1][1]), nullptr, 0);
+  close(pipes[0][0]);
+  close(pipes[1][1]);
+  relay.join();
+}
+
+} // namespace relay
+
+template <class Func>
+void Measure(const char* name, const std::string& input, const std::string& output, size_t size,
+             Func&& func) {
+  int in_fd = open(input.c_str(), O_RDONLY | O_CLOEXEC);
+  int out_fd = open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (in_fd < 0 || out_fd < 0) exit(1);
+  using Clock = std::chrono::steady_clock;
+  auto start = Clock::now();
+  func(in_fd, out_fd, size);
+  double sec = std::chrono::duration<double>(Clock::now() - start).count();
+  off_t written = lseek(out_fd, 0, SEEK_END);
+  close(in_fd);
+  close(out_fd);
+  printf("%-8s %.1f MiB/s", name, size / sec / (1 << 20));
+  if ((size_t)written != size) printf(" (output %ld bytes)", (long)written);
+  puts("");
+  fflush(stdout);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  size_t size = (argc > 1 ? atol(argv[1]) : 1024) << 20;
+  int rounds = argc > 2 ? atoi(argv[2]) : 3;
+  std::string dir = argc > 3 ? argv[3] : "/tmp";
+  std::string input = dir + "/splice-bench-in", output = dir + "/splice-bench-out";
+  {
+    int fd = open(input.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) return 1;
+    std::vector<char> buf(1 << 20, 'a');
+    for (size_t i = 0; i < size; i += buf.size()) {
+      if (write(fd, buf.data(), buf.size()) != (ssize_t)buf.size()) return 1;
+    }
+    close(fd);
+  }
+  for (int round = 0; round < rounds; round++) {
+    Measure("legacy", input, output, size, legacy::Run);
+    Measure("relay", input, output, size, relay::Run);
+  }
+  unlink(input.c_str());
+  unlink(output.c_str());
+}
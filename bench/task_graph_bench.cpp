@@ -0,0 +1,164 @@
+// Push & drain submissions through the task graph, compared with the previous
+//  unordered_map + PriorityCompare implementation
+// Usage: task_graph_bench [testdata=10000] [stages=4] [submissions=4]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <queue>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "task_graph.h"
+
+namespace {
+
+struct Shape {
+  int testdata, stages, submissions;
+};
+
+namespace legacy {
+
+struct TaskEntry {
+  static long task_count;
+  long id;
+  long submission_internal_id;
+  Task task;
+  long priority;
+  int task_order;
+  int indeg;
+  std::vector<long> edges;
+
+  TaskEntry() {}
+  TaskEntry(int sub_id, const Task& task, long priority, int order = 0) :
+      id(task_count++), submission_internal_id(sub_id),
+      task(task), priority(priority), task_order(order), indeg(0) {}
+  bool operator<(const TaskEntry& x) const {
+    return std::make_tuple(priority, -submission_internal_id, -task_order) <
+           std::make_tuple(x.priority, -x.submission_internal_id, -x.task_order);
+  }
+};
+long TaskEntry::task_count = 0;
+
+std::unordered_map<long, TaskEntry> task_list;
+struct PriorityCompare {
+  bool operator()(long a, long b) { return task_list[a] < task_list[b]; }
+};
+std::priority_queue<long, std::vector<long>, PriorityCompare> task_queue;
+
+void Link(TaskEntry& a, TaskEntry& b) {
+  a.edges.push_back(b.id);
+  b.indeg++;
+}
+void Insert(TaskEntry&& task) {
+  long tid = task.id;
+  int indeg = task.indeg;
+  task_list.insert({tid, std::move(task)});
+  if (!indeg) task_queue.push(tid);
+}
+
+void Push(int id, const Shape& shape) {
+  std::vector<std::vector<TaskEntry>> executes(shape.testdata);
+  std::vector<TaskEntry> scorings;
+  TaskEntry summary(id, {TaskType::SUMMARY, 0, 0}, 0);
+  TaskEntry compile(id, {TaskType::COMPILE, 0, 0}, 0);
+  for (int i = 0; i < shape.testdata; i++) {
+    for (int j = 0; j < shape.stages; j++) {
+      executes[i].emplace_back(id, (Task){TaskType::EXECUTE, i, j}, 0, i);
+      if (j > 0) Link(executes[i][j - 1], executes[i][j]);
+    }
+    scorings.emplace_back(id, (Task){TaskType::SCORING, i, shape.stages - 1}, 0, i);
+    Link(executes[i].back(), scorings.back());
+    Link(scorings.back(), summary);
+    Link(compile, executes[i][0]);
+  }
+  Insert(std::move(compile));
+  for (auto& i : executes) for (auto& j : i) Insert(std::move(j));
+  for (auto& i : scorings) Insert(std::move(i));
+  Insert(std::move(summary));
+}
+
+size_t Drain() {
+  size_t count = 0;
+  while (!task_queue.empty()) {
+    long tid = task_queue.top();
+    task_queue.pop();
+    auto& task = task_list[tid];
+    for (long nxt : task.edges) {
+      if (auto& nxt_task = task_list[nxt]; !--nxt_task.indeg) task_queue.push(nxt);
+    }
+    task_list.erase(tid);
+    count++;
+  }
+  return count;
+}
+
+} // namespace legacy
+
+namespace arena {
+
+TaskArena task_arena;
+ReadyQueue task_queue;
+
+void Push(int id, const Shape& shape) {
+  uint32_t slot = task_arena.Allocate(id, 0, nullptr);
+  TaskGraph& graph = task_arena[slot].graph;
+  uint32_t compile = graph.AddNode({TaskType::COMPILE, 0, 0});
+  std::vector<uint32_t> scorings(shape.testdata);
+  for (int i = 0; i < shape.testdata; i++) {
+    uint32_t prev = compile;
+    for (int j = 0; j < shape.stages; j++) {
+      uint32_t execute = graph.AddNode({TaskType::EXECUTE, i, j}, i);
+      graph.Link(prev, execute);
+      prev = execute;
+    }
+    scorings[i] = graph.AddNode({TaskType::SCORING, i, shape.stages - 1}, i);
+    graph.Link(prev, scorings[i]);
+  }
+  uint32_t summary = graph.AddNode({TaskType::SUMMARY, 0, 0});
+  for (uint32_t i : scorings) graph.Link(i, summary);
+  graph.Freeze();
+  graph.ForEachRoot([&](uint32_t node) { task_queue.push(task_arena.MakeReady(slot, node)); });
+}
+
+size_t Drain() {
+  size_t count = 0;
+  while (!task_queue.empty()) {
+    TaskRef ref = task_queue.top().ref;
+    task_queue.pop();
+    auto& slot = task_arena[ref.slot];
+    slot.graph.Remove(ref.node, [&](uint32_t nxt) { task_queue.push(task_arena.MakeReady(ref.slot, nxt)); });
+    if (!slot.graph.Remaining()) task_arena.Release(ref.slot);
+    count++;
+  }
+  return count;
+}
+
+} // namespace arena
+
+template <class PushFunc, class DrainFunc>
+void Run(const char* name, const Shape& shape, PushFunc&& push, DrainFunc&& drain) {
+  using Clock = std::chrono::steady_clock;
+  auto start = Clock::now();
+  for (int i = 0; i < shape.submissions; i++) push(i, shape);
+  auto mid = Clock::now();
+  size_t count = drain();
+  auto end = Clock::now();
+  auto ns = [](auto dur) { return std::chrono::duration<double, std::nano>(dur).count(); };
+  printf("%-8s tasks=%zu push=%.1fms drain=%.1fms (%.1f ns/task)\n", name, count,
+         ns(mid - start) / 1e6, ns(end - mid) / 1e6, ns(end - start) / count);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  Shape shape{10000, 4, 4};
+  if (argc > 1) shape.testdata = atoi(argv[1]);
+  if (argc > 2) shape.stages = atoi(argv[2]);
+  if (argc > 3) shape.submissions = atoi(argv[3]);
+  for (int round = 0; round < 3; round++) {
+    Run("legacy", shape, legacy::Push, legacy::Drain);
+    Run("arena", shape, arena::Push, arena::Drain);
+  }
+}
@@ -0,0 +1,99 @@
+// Copy the testdata of one problem from several threads at once (as SetupExecute does for each
+//  slot in non-bind mode) under one exclusive mutex versus the shared TdFileLock; also measure
+//  how long replacing the testdata waits while the copies keep going
+// Usage: td_file_lock_bench [threads=8] [size_mb=64] [copies=8] [dir=/tmp]
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "paths.h"
+#include "utils.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double Seconds(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+template <class Lock>
+void Measure(const char* name, const fs::path& dir, int threads, int copies, long size_mb, Lock&& lock) {
+  std::vector<std::thread> workers;
+  auto start = Clock::now();
+  for (int i = 0; i < threads; i++) {
+    workers.emplace_back([&, i]() {
+      fs::path dest = dir / ("box" + std::to_string(i));
+      for (int j = 0; j < copies; j++) {
+        {
+          auto lck = lock();
+          Copy(dir / "input", dest, kPerm666);
+        }
+        fs::remove(dest);
+      }
+    });
+  }
+  for (auto& worker : workers) worker.join();
+  double sec = Seconds(start);
+  printf("%-10s %.1f copies/s, %.1f MiB/s\n", name, threads * copies / sec,
+         threads * copies * size_mb / sec);
+}
+
+void MeasureWriter(const fs::path& dir, int threads) {
+  TdFileLock lock;
+  std::atomic_bool stop = false;
+  std::vector<std::thread> workers;
+  for (int i = 0; i < threads; i++) {
+    workers.emplace_back([&, i]() {
+      fs::path dest = dir / ("box" + std::to_string(i));
+      while (!stop) {
+        {
+          auto lck = lock.Shared(1);
+          Copy(dir / "input", dest, kPerm666);
+        }
+        fs::remove(dest);
+      }
+    });
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  auto start = Clock::now();
+  {
+    auto lck = lock.Exclusive(1);
+    printf("%-10s replacing waited %.1f ms\n", "shared", Seconds(start) * 1000);
+  }
+  stop = true;
+  for (auto& worker : workers) worker.join();
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  int threads = argc > 1 ? atoi(argv[1]) : 8;
+  long size_mb = argc > 2 ? atol(argv[2]) : 64;
+  int copies = argc > 3 ? atoi(argv[3]) : 8;
+  std::string tmpl = (argc > 4 ? std::string(argv[4]) : "/tmp") + "/td-lock-bench-XXXXXX";
+  if (!mkdtemp(tmpl.data())) return 1;
+  fs::path dir = tmpl;
+  {
+    std::ofstream fout(dir / "input");
+    std::string block(1 << 20, '1');
+    for (long i = 0; i < size_mb; i++) {
+      block[i % block.size()] = '\n'; // not all the same, so that no filesystem can elide it
+      fout << block;
+    }
+  }
+  std::mutex mtx;
+  TdFileLock lock;
+  for (int round = 0; round < 3; round++) {
+    Measure("exclusive", dir, threads, copies, size_mb, [&]() { return std::unique_lock(mtx); });
+    Measure("shared", dir, threads, copies, size_mb, [&]() { return lock.Shared(1); });
+  }
+  MeasureWriter(dir, threads);
+  fs::remove_all(dir);
+}
@@ -1,7 +1,7 @@
 #ifndef INCLUDE_LOGGER_H_
 #define INCLUDE_LOGGER_H_
 
-// Call this before any call to judge submissions. Otherwise, the logger may deadlock.
+// Call this before any call to judge submissions.
 void InitLogger();
 
 #endif  // INCLUDE_LOGGER_H_
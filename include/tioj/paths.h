@@ -4,6 +4,7 @@
 #include <mutex>
 #include <filesystem>
 #include <unordered_map>
+#include <condition_variable>
 
 namespace fs = std::filesystem;
 
@@ -17,12 +18,38 @@ extern fs::path kDataDir;
 
 } // internal
 
+// Per-problem lock of the testdata files: box setups only read them and share the lock, while
+//  replacing them (after a download) takes it exclusively
+// Waiting writers go before new readers, so that busy slots cannot starve a replacement
+// An entry is freed once nobody holds or waits for it
 class TdFileLock {
-  std::mutex global_lock_;
-  std::unordered_map<int, std::mutex> mutex_map_;
+  struct Entry {
+    int users = 0; // holding or waiting
+    int readers = 0;
+    int waiting_writers = 0;
+    bool writer = false;
+    std::condition_variable cv;
+  };
+  std::mutex mtx_;
+  std::unordered_map<int, Entry> entries_;
+
+  void Lock_(int id, bool exclusive);
+  void Unlock_(int id, bool exclusive);
  public:
-  std::mutex& operator[](int id);
-  // TODO: free mutexes?
+  template <bool kExclusive> class Guard {
+    TdFileLock& parent_;
+    int id_;
+   public:
+    Guard(TdFileLock& parent, int id) : parent_(parent), id_(id) { parent_.Lock_(id, kExclusive); }
+    ~Guard() { parent_.Unlock_(id_, kExclusive); }
+    Guard(const Guard&) = delete;
+    Guard& operator=(const Guard&) = delete;
+  };
+
+  Guard<false> Shared(int id) { return Guard<false>(*this, id); }
+  Guard<true> Exclusive(int id) { return Guard<true>(*this, id); }
+  // number of problems with an entry; for testing
+  size_t Size();
 };
 extern TdFileLock td_file_lock;
 
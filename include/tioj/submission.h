@@ -9,6 +9,16 @@
 #include <cjail/cjail.h>
 
 extern int kMaxParallel;
+// number of threads for box setup & teardown
+extern int kSetupThreads;
+// number of execute boxes staged ahead while all slots are busy
+extern int kLookahead;
+// expose testdata in boxes by read-only bind mounts instead of copying
+extern bool kBindTestdata;
+// create and remove the files of boxes in io_uring batches
+extern bool kIoUringSetup;
+// removed boxes are deleted in the background; removal waits if this much (KiB) is not deleted yet
+extern long kMaxTrash;
 extern cpu_set_t kPinnedCpus;
 // KiB
 extern long kMaxRSS;
@@ -110,6 +120,7 @@ class Submission {
   SummaryType summary_type;
   Compiler specjudge_lang;
   Compiler summary_lang;
+  // $INPUT, $OUTPUT and (specjudge only) $HEADERS, the directory of the judge headers, are expanded
   std::string user_compile_args, specjudge_compile_args;
   int stages;
   bool judge_between_stages;
@@ -143,6 +154,11 @@ class Submission {
     std::function<void(const Submission&, const SubmissionResult&, size_t queue_size_before_pop)> ReportFinalized;
   };
   Reporter reporter; // callbacks for result reporting
+  // Optional; if set, each testdata is waited for by a FETCH_TESTDATA task before its first execution,
+  //  so that compilation and the testdata already available need not wait for the rest
+  // fetch_testdata(sub, subtask, done) should not block, and should call done(success) from any thread
+  //  (or within the call) once input_file & answer_file are in place; the submission gets JE on failure
+  std::function<void(const Submission&, int subtask, std::function<void(bool)> done)> fetch_testdata;
   bool report_intermediate_stage; // whether to call ReportScoringResult in intermediate stages
   bool remove_submission; // remove submission code after judge
 
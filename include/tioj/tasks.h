@@ -5,7 +5,8 @@
   X(COMPILE) \
   X(EXECUTE) \
   X(SCORING) /* special judge */ \
-  X(SUMMARY)
+  X(SUMMARY) \
+  X(FETCH_TESTDATA) /* not run in a sandbox; see Submission::fetch_testdata */
 enum class TaskType {
 #define X(name) name,
   ENUM_TASK_TYPE_
@@ -1,10 +1,36 @@
 #include "database.h"
 
-void Database::Init() {
+void Database::Init_() {
   if (!db_) db_ = std::make_unique<Storage>(InitStorage());
 }
 
+void Database::Init() {
+  std::lock_guard lck(mtx_);
+  Init_();
+}
+
+std::vector<Testdata> Database::ProblemTd(int problem_id) {
+  using namespace sqlite_orm;
+  std::lock_guard lck(mtx_);
+  Init_();
+  return db_->get_all<Testdata>(where(c(&Testdata::problem_id) == problem_id));
+}
+
+std::vector<Testdata> Database::AllTd() {
+  std::lock_guard lck(mtx_);
+  Init_();
+  return db_->get_all<Testdata>();
+}
+
 void Database::UpdateTd(const std::vector<Testdata>& td) {
-  Init();
+  std::lock_guard lck(mtx_);
+  Init_();
   db_->replace_range(td.begin(), td.end());
 }
+
+void Database::RemoveProblem(int problem_id) {
+  using namespace sqlite_orm;
+  std::lock_guard lck(mtx_);
+  Init_();
+  db_->remove_all<Testdata>(where(c(&Testdata::problem_id) == problem_id));
+}
@@ -1,6 +1,8 @@
 #ifndef DATABASE_H_
 #define DATABASE_H_
 
+#include <mutex>
+#include <string>
 #include <sqlite_orm/sqlite_orm.h>
 #include "tioj/utils.h"
 #include "paths.h"
@@ -13,6 +15,10 @@ struct Testdata {
   long timestamp;
   bool input_compressed;
   bool output_compressed;
+  long last_used; // UNIX timestamp of the last submission of the problem
+  // hex SHA-256 of the decompressed content, naming the blobs in td-pool; empty if unknown
+  std::string input_blob;
+  std::string output_blob;
 };
 
 namespace {
@@ -31,30 +37,34 @@ inline auto InitStorage() {
                  make_column("order", &Testdata::order),
                  make_column("timestamp", &Testdata::timestamp),
                  make_column("input_compressed", &Testdata::input_compressed, default_value(false)),
-                 make_column("output_compressed", &Testdata::output_compressed, default_value(false))));
+                 make_column("output_compressed", &Testdata::output_compressed, default_value(false)),
+                 make_column("last_used", &Testdata::last_used, default_value(0)),
+                 make_column("input_blob", &Testdata::input_blob, default_value("")),
+                 make_column("output_blob", &Testdata::output_blob, default_value(""))));
   storage.sync_schema(true);
   return storage;
 }
 
 } // namespace
 
+// thread-safe, since submissions are prepared concurrently
 class Database {
  public:
   using Storage = decltype(InitStorage());
 
  private:
+  std::mutex mtx_;
   std::unique_ptr<Storage> db_;
 
+  void Init_();
+
  public:
   void Init();
 
-  auto ProblemTd(int problem_id) {
-    using namespace sqlite_orm;
-    Init();
-    return db_->iterate<Testdata>(where(c(&Testdata::problem_id) == problem_id));
-  }
-
+  std::vector<Testdata> ProblemTd(int problem_id);
+  std::vector<Testdata> AllTd();
   void UpdateTd(const std::vector<Testdata>& td);
+  void RemoveProblem(int problem_id);
 };
 
 #endif  // DATABASE_H_
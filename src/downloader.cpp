@@ -0,0 +1,418 @@
+#include "downloader.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <deque>
+#include <mutex>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <condition_variable>
+
+#include <zstd.h>
+#include <openssl/evp.h>
+#include <spdlog/spdlog.h>
+
+#include "http_utils.h"
+
+namespace {
+
+constexpr size_t kBufferSize = 1 << 20;
+constexpr size_t kBufferAlign = 4096;
+// per transfer; bounds the data received but not written yet
+constexpr size_t kBuffersPerTransfer = 4;
+
+struct Buffer {
+  std::unique_ptr<char, decltype(&free)> data{nullptr, &free};
+  size_t size = 0;
+
+  Buffer() = default;
+  explicit Buffer(bool) : data((char*)aligned_alloc(kBufferAlign, kBufferSize), &free) {}
+};
+
+// A leftover file may be a link of another one (see the td-pool blobs), so it is replaced instead
+//  of written through
+int CreateFile(const fs::path& path) {
+  unlink(path.c_str());
+  return open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+}
+
+// Receives data on the transfer thread and writes it on its own thread
+class FileSink {
+  int fd_;
+  ZSTD_DCtx* dctx_;
+  bool keep_compressed_;
+  size_t frame_hint_; // last return value of ZSTD_decompressStream; 0 at the end of a frame
+  EVP_MD_CTX* md_;
+  std::string hash_;
+  std::atomic_size_t& written_;
+
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::vector<Buffer> free_;
+  std::deque<Buffer> full_;
+  bool closing_;
+  bool ok_;
+  Buffer current_; // being filled by Push
+  Buffer output_; // decompressed data; used only by the writer thread
+  std::thread thread_;
+
+  bool WriteOut(const char* data, size_t len) {
+    while (len) {
+      ssize_t ret = write(fd_, data, len);
+      if (ret < 0) {
+        if (errno == EINTR) continue;
+        return false;
+      }
+      data += ret;
+      len -= ret;
+      written_ += ret;
+    }
+    return true;
+  }
+
+  // decompressed content
+  bool Emit(const char* data, size_t len) {
+    if (!EVP_DigestUpdate(md_, data, len)) return false;
+    return keep_compressed_ || WriteOut(data, len);
+  }
+
+  bool Consume(const Buffer& buf) {
+    if (!dctx_) return Emit(buf.data.get(), buf.size);
+    if (keep_compressed_ && !WriteOut(buf.data.get(), buf.size)) return false;
+    ZSTD_inBuffer input = {buf.data.get(), buf.size, 0};
+    // continue while the output is filled up, since the decoder may hold more (unless the frame
+    //  is done; decoding nothing after it would replace frame_hint_ with the next header size)
+    for (bool filled = false; input.pos < input.size || (filled && frame_hint_);) {
+      ZSTD_outBuffer output = {output_.data.get(), kBufferSize, output_.size};
+      frame_hint_ = ZSTD_decompressStream(dctx_, &output, &input);
+      if (ZSTD_isError(frame_hint_)) return false;
+      output_.size = output.pos;
+      filled = output.pos == kBufferSize;
+      if (filled) {
+        if (!Emit(output_.data.get(), output_.size)) return false;
+        output_.size = 0;
+      }
+    }
+    return true;
+  }
+
+  void Writer() {
+    std::unique_lock lck(mtx_);
+    while (true) {
+      cv_.wait(lck, [&]{ return closing_ || !full_.empty(); });
+      if (full_.empty()) return;
+      Buffer buf = std::move(full_.front());
+      full_.pop_front();
+      bool ok = ok_;
+      lck.unlock();
+      // after an error, just drain
+      if (ok) ok = Consume(buf);
+      lck.lock();
+      ok_ = ok_ && ok;
+      buf.size = 0;
+      free_.push_back(std::move(buf));
+      cv_.notify_all();
+    }
+  }
+
+ public:
+  FileSink(const fs::path& path, bool compressed, bool keep_compressed, std::atomic_size_t& written) :
+      fd_(CreateFile(path)),
+      dctx_(compressed ? ZSTD_createDCtx() : nullptr), keep_compressed_(keep_compressed),
+      frame_hint_(0), md_(EVP_MD_CTX_new()), written_(written), closing_(false),
+      ok_(fd_ >= 0 && md_ && EVP_DigestInit_ex(md_, EVP_sha256(), nullptr)) {
+    if (fd_ < 0) spdlog::warn("Failed opening {}: {}", path.c_str(), strerror(errno));
+    for (size_t i = 0; i < kBuffersPerTransfer; i++) free_.emplace_back(true);
+    if (compressed) output_ = Buffer(true);
+    thread_ = std::thread(&FileSink::Writer, this);
+  }
+  ~FileSink() {
+    {
+      std::lock_guard lck(mtx_);
+      closing_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) thread_.join();
+    if (dctx_) ZSTD_freeDCtx(dctx_);
+    if (md_) EVP_MD_CTX_free(md_);
+    if (fd_ >= 0) close(fd_);
+  }
+
+  // called by the content receiver; false aborts the transfer
+  bool Push(const char* data, size_t len) {
+    while (len) {
+      if (!current_.data) {
+        std::unique_lock lck(mtx_);
+        cv_.wait(lck, [&]{ return !ok_ || !free_.empty(); });
+        if (!ok_) return false;
+        current_ = std::move(free_.back());
+        free_.pop_back();
+      }
+      size_t num = std::min(len, kBufferSize - current_.size);
+      memcpy(current_.data.get() + current_.size, data, num);
+      current_.size += num;
+      data += num;
+      len -= num;
+      if (current_.size == kBufferSize) {
+        std::lock_guard lck(mtx_);
+        full_.push_back(std::move(current_));
+        current_ = Buffer();
+        cv_.notify_all();
+      }
+    }
+    std::lock_guard lck(mtx_);
+    return ok_;
+  }
+
+  // write everything out; false if anything failed or the compressed data is truncated
+  bool Close() {
+    {
+      std::lock_guard lck(mtx_);
+      if (current_.data && current_.size) full_.push_back(std::move(current_));
+      current_ = Buffer();
+      closing_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+    bool ok = ok_;
+    if (ok && dctx_) {
+      ok = frame_hint_ == 0 && Emit(output_.data.get(), output_.size);
+    }
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digest_len = 0;
+    if (ok && EVP_DigestFinal_ex(md_, digest, &digest_len)) {
+      hash_.clear();
+      for (unsigned int i = 0; i < digest_len; i++) hash_ += fmt::format("{:02x}", digest[i]);
+    } else {
+      ok = false;
+    }
+    if (fd_ >= 0 && close(fd_) < 0) ok = false;
+    fd_ = -1;
+    return ok;
+  }
+
+  // after a successful Close
+  const std::string& Hash() const { return hash_; }
+};
+
+double Seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+inline double MiB(size_t bytes) {
+  return bytes / 1048576.;
+}
+
+// for If-Range; a weak ETag cannot be used there
+std::string ResponseValidator(const httplib::Response& res) {
+  std::string etag = res.get_header_value("ETag");
+  if (etag.size() && etag.compare(0, 2, "W/") != 0) return etag;
+  return res.get_header_value("Last-Modified");
+}
+
+// first byte position of "Content-Range: bytes <first>-<last>/<length>"; -1 if malformed
+ssize_t ContentRangeStart(const httplib::Response& res) {
+  std::string range = res.get_header_value("Content-Range");
+  if (range.compare(0, 6, "bytes ") != 0) return -1;
+  char* end;
+  errno = 0;
+  long long first = strtoll(range.c_str() + 6, &end, 10);
+  if (errno || end == range.c_str() + 6 || *end != '-' || first < 0) return -1;
+  return first;
+}
+
+} // namespace
+
+Downloader::Downloader(const std::string& url, int concurrency) :
+    url_(url), concurrency_(std::max(concurrency, 1)),
+    files_(0), received_(0), written_(0), seconds_(0) {}
+
+bool Downloader::Fetch(httplib::Client& cli, const Item& item, std::string& hash) {
+  std::unique_ptr<FileSink> sink;
+  auto Restart = [&]() {
+    sink.reset(); // close the previous attempt before replacing
+    sink = std::make_unique<FileSink>(item.path, item.compressed, item.keep_compressed, written_);
+  };
+  // bytes of the body handed to sink; after a dropped connection, the transfer resumes from here,
+  //  and since the sink (with its zstd stream) is kept, it simply continues
+  size_t offset = 0;
+  // ETag (or Last-Modified) of the response being received; a resumed part must carry the same
+  //  one, so that a file updated on the server in between is not spliced with the old part
+  std::string validator;
+  // retries without progress are limited and backed off; resuming after progress is not
+  for (int retry = 0;;) {
+    size_t start = offset;
+    bool broken = false;
+    if (!offset) Restart();
+    httplib::Headers headers;
+    if (offset) {
+      headers.insert(httplib::make_range_header({{(ssize_t)offset, -1}}));
+      // a server honoring it sends the whole (new) file if it changed
+      headers.emplace("If-Range", validator);
+    }
+    auto res = HTTPRequest<HTTPGet>(cli, item.endpoint, item.params, headers,
+        [&](const httplib::Response& response) {
+          if (!http_utils::IsSuccess(response.status)) return false;
+          std::string current = ResponseValidator(response);
+          if (offset && response.status == 206) {
+            if (current == validator && ContentRangeStart(response) == (ssize_t)offset) return true;
+            // not the continuation of what was received; drop the response and start over
+            spdlog::info("Range response of {} {} does not continue the previous one",
+                         item.endpoint, http_utils::FormatOneParam(item.params));
+            offset = 0;
+            return false;
+          }
+          // the range is not supported or the file changed; start over
+          if (offset) {
+            Restart();
+            offset = start = 0;
+          }
+          validator = current;
+          return true;
+        },
+        [&](const char* data, size_t data_length) {
+          received_ += data_length;
+          if (!sink->Push(data, data_length)) {
+            broken = true;
+            return false;
+          }
+          offset += data_length;
+          return true;
+        });
+    if (IsSuccess(res)) break;
+    // corrupted data or failed writes, or no validator to tell the file unchanged; start over
+    if (broken || validator.empty()) offset = 0;
+    if (!broken && offset > start) {
+      spdlog::info("Resuming {} {} at byte {}", item.endpoint, http_utils::FormatOneParam(item.params), offset);
+      continue;
+    }
+    spdlog::debug("Error code={} status={}", (int)res.error(), res ? res->status : -1);
+    if (++retry == http_utils::kRetries) {
+      spdlog::warn("Request {} {} failed after {} retries", HTTPGet::method_name, item.endpoint, retry);
+      return false;
+    }
+    std::this_thread::sleep_for(http_utils::RetryDelay(retry - 1));
+  }
+  if (!sink->Close()) {
+    spdlog::warn("Failed writing {} (incomplete or corrupted data)", item.path.c_str());
+    return false;
+  }
+  hash = sink->Hash();
+  files_++;
+  return true;
+}
+
+bool Downloader::Run(const std::vector<Item>& items, const std::function<void(size_t)>& on_done) {
+  if (items.empty()) return true;
+  auto start = std::chrono::steady_clock::now();
+  std::atomic_size_t next = 0;
+  std::atomic_bool failed = false;
+  std::mutex mtx;
+  std::condition_variable cv;
+  int running = std::min((size_t)concurrency_, items.size());
+  std::vector<std::thread> threads;
+  hashes_.assign(items.size(), std::string());
+  for (int i = running; i > 0; i--) {
+    threads.emplace_back([&]() {
+      httplib::Client cli(url_);
+      for (size_t idx; !failed && (idx = next++) < items.size();) {
+        if (!Fetch(cli, items[idx], hashes_[idx])) {
+          failed = true;
+        } else if (on_done) {
+          on_done(idx);
+        }
+      }
+      std::lock_guard lck(mtx);
+      if (--running == 0) cv.notify_one();
+    });
+  }
+  {
+    std::unique_lock lck(mtx);
+    while (!cv.wait_for(lck, std::chrono::seconds(1), [&]{ return running == 0; })) {
+      spdlog::info("Downloading: {}/{} files, {:.1f} MiB, {:.1f} MiB/s",
+                   files_.load(), items.size(), MiB(received_), MiB(received_) / Seconds(start));
+    }
+  }
+  for (auto& thread : threads) thread.join();
+  seconds_ = Seconds(start);
+  spdlog::info("Downloaded {}/{} files, {:.1f} MiB in {:.2f} s ({:.1f} MiB/s), {:.1f} MiB written",
+               files_.load(), items.size(), MiB(received_), seconds_, MiB(received_) / seconds_, MiB(written_));
+  return !failed;
+}
+
+Downloader::Stats Downloader::GetStats() const {
+  return {files_, received_, written_, seconds_};
+}
+
+bool DecompressFile(const fs::path& from, const fs::path& to) {
+  fs::path temp = to;
+  temp += ".tmp";
+  int in_fd = open(from.c_str(), O_RDONLY | O_CLOEXEC);
+  if (in_fd < 0) {
+    spdlog::warn("Failed opening {}: {}", from.c_str(), strerror(errno));
+    return false;
+  }
+  std::atomic_size_t written = 0;
+  bool ok;
+  {
+    // reads are handed to the writer thread of the sink, as in downloads
+    FileSink sink(temp, true, false, written);
+    Buffer buf(true);
+    ssize_t ret;
+    while ((ret = read(in_fd, buf.data.get(), kBufferSize)) > 0) {
+      if (!sink.Push(buf.data.get(), ret)) break;
+    }
+    ok = ret == 0 && sink.Close();
+  }
+  close(in_fd);
+  std::error_code ec;
+  if (ok) fs::rename(temp, to, ec);
+  if (!ok || ec) {
+    spdlog::warn("Failed decompressing {} into {}", from.c_str(), to.c_str());
+    fs::remove(temp, ec);
+    return false;
+  }
+  spdlog::debug("Decompressed {} into {}: {} bytes", from.c_str(), to.c_str(), written.load());
+  return true;
+}
+
+TransferRegistry::State TransferRegistry::TryBegin(long id, long version) {
+  std::lock_guard lck(mtx_);
+  auto it = entries_.find(id);
+  if (it != entries_.end()) {
+    if (!it->second.done) return State::IN_FLIGHT;
+    if (it->second.version == version) return State::DONE;
+  }
+  entries_[id] = {version, false};
+  return State::OWNER;
+}
+
+void TransferRegistry::End(long id, long version, bool ok) {
+  {
+    std::lock_guard lck(mtx_);
+    if (ok) {
+      entries_[id] = {version, true};
+    } else {
+      entries_.erase(id);
+    }
+  }
+  cv_.notify_all();
+}
+
+void TransferRegistry::Wait(long id) {
+  std::unique_lock lck(mtx_);
+  cv_.wait(lck, [&]{
+    auto it = entries_.find(id);
+    return it == entries_.end() || it->second.done;
+  });
+}
+
+void TransferRegistry::Forget(long id) {
+  std::lock_guard lck(mtx_);
+  if (auto it = entries_.find(id); it != entries_.end() && it->second.done) entries_.erase(it);
+}
@@ -0,0 +1,91 @@
+#ifndef DOWNLOADER_H_
+#define DOWNLOADER_H_
+
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <functional>
+#include <filesystem>
+#include <unordered_map>
+#include <condition_variable>
+
+#include <httplib.h>
+
+namespace fs = std::filesystem;
+
+// Download a list of files with a bounded number of concurrent transfers
+// Each transfer has its own connection; the received data is handed in large aligned buffers to
+//  another thread that decompresses (zstd), hashes (SHA-256) and writes it, so that disk writes do
+//  not stall receiving
+class Downloader {
+ public:
+  struct Item {
+    std::string endpoint;
+    httplib::Params params;
+    fs::path path; // replaced (not written through); use a temporary name and rename after success
+    bool compressed;
+    bool keep_compressed = false; // write as received; it is still decoded for checking and hashing
+  };
+  struct Stats {
+    size_t files;
+    size_t received_bytes; // as transferred
+    size_t written_bytes;
+    double seconds;
+  };
+
+  Downloader(const std::string& url, int concurrency);
+
+  // each transfer is retried as RequestRetry does; if one fails in the end, the ones not started
+  //  yet are skipped and false is returned
+  // progress is logged every second
+  // on_done(i), if given, is called on a transfer thread once items[i] is completely written
+  bool Run(const std::vector<Item>&, const std::function<void(size_t)>& on_done = nullptr);
+  Stats GetStats() const;
+  // hex SHA-256 of the decompressed content of items[i]; available from on_done(i)
+  const std::string& Hash(size_t i) const { return hashes_[i]; }
+
+ private:
+  std::string url_;
+  int concurrency_;
+  std::atomic_size_t files_, received_, written_;
+  double seconds_;
+  std::vector<std::string> hashes_;
+
+  bool Fetch(httplib::Client&, const Item&, std::string& hash);
+};
+
+// Decompress a zstd file through a temporary file, which is renamed to `to` on success
+bool DecompressFile(const fs::path& from, const fs::path& to);
+
+// Process-wide record of transfers keyed by (id, version), so that concurrent requesters of the
+//  same file share one transfer, and a finished transfer is not repeated
+// Acquiring never blocks, so holding some transfers while waiting for others cannot deadlock
+class TransferRegistry {
+ public:
+  enum class State {
+    OWNER, // the caller should transfer it and call End
+    IN_FLIGHT, // another caller is transferring it; call Wait and try again
+    DONE, // already transferred
+  };
+
+  State TryBegin(long id, long version);
+  // ok=false lets the next requester try again
+  void End(long id, long version, bool ok);
+  // block until the transfer of id in progress (if any) ends
+  void Wait(long id);
+  // the finished transfer of id is removed (e.g. the file is deleted), so it is transferred again
+  //  on the next request
+  void Forget(long id);
+
+ private:
+  struct Entry {
+    long version;
+    bool done;
+  };
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::unordered_map<long, Entry> entries_;
+};
+
+#endif  // DOWNLOADER_H_
@@ -1,4 +1,6 @@
 #include "http_utils.h"
+#include <random>
+#include <algorithm>
 #include <spdlog/fmt/bundled/ranges.h>
 
 namespace http_utils {
@@ -24,6 +26,14 @@ bool IsSuccess(int code) {
   return code >= 200 && code < 299;
 }
 
+std::chrono::milliseconds RetryDelay(int retry) {
+  constexpr long kBaseMs = 500, kMaxMs = 16000;
+  // half fixed, half random, so that clients failing together do not retry together
+  long delay = std::min(kBaseMs << std::min(retry, 16), kMaxMs);
+  thread_local std::mt19937 rng(std::random_device{}());
+  return std::chrono::milliseconds(delay / 2 + std::uniform_int_distribution<long>(0, delay / 2)(rng));
+}
+
 } // namespace http_utils
 
 bool IsSuccess(const httplib::Result& res) {
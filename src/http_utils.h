@@ -4,6 +4,7 @@
 /// Log HTTP requests
 
 #include <chrono>
+#include <thread>
 #include <optional>
 #include <type_traits>
 #include <httplib.h>
@@ -47,6 +48,10 @@ template <typename T, typename... Args> class has_##func { \
 
 bool IsSuccess(int code);
 
+constexpr int kRetries = 5;
+// exponential backoff with jitter before the retry-th retry (0-based)
+std::chrono::milliseconds RetryDelay(int retry);
+
 } // namespace http_utils
 
 bool IsSuccess(const httplib::Result& res);
@@ -75,16 +80,15 @@ httplib::Result HTTPRequest(httplib::Client& cli, const std::string& endpoint, T
 template <class Method, class Func, class... T>
 httplib::Result RequestRetryInit(
     Func&& init, httplib::Client& cli, const std::string& endpoint, T&&... params) {
-  const int kRetries = 5;
-  using namespace std::chrono_literals;
+  using http_utils::kRetries;
   std::unique_ptr<httplib::Result> last_res;
   for (int i = 0; i < kRetries; i++) {
+    if (i) std::this_thread::sleep_for(http_utils::RetryDelay(i - 1));
     init();
     last_res = std::make_unique<httplib::Result>(
             HTTPRequest<Method>(cli, endpoint, std::forward<T>(params)...));
     if (IsSuccess(*last_res)) return std::move(*last_res);
     spdlog::debug("Error code={} status={}", (int)last_res->error(), *last_res ? (*last_res)->status : -1);
-    std::this_thread::sleep_for(1s);
   }
   spdlog::warn("Request {} {} failed after {} retries", Method::method_name, endpoint, kRetries);
   return std::move(*last_res);
@@ -38,10 +38,18 @@ void ParseConfig(const fs::path& conf_path) {
   if (submission_root.size()) kSubmissionRoot = submission_root;
   if (testdata_root.size()) kTestdataRoot = testdata_root;
   kMaxParallel = ini[""]["parallel"] | kMaxParallel;
+  kSetupThreads = ini[""]["setup_threads"] | kSetupThreads;
+  kLookahead = ini[""]["lookahead"] | kLookahead;
+  kBindTestdata = ini[""]["bind_testdata"] | kBindTestdata;
+  kIoUringSetup = ini[""]["io_uring_setup"] | kIoUringSetup;
   SetPinnedCPU(ini[""]["pinned_cpus"] | "none");
   kMaxRSS = (ini[""]["max_rss_per_task_mb"] | (kMaxRSS / 1024)) * 1024;
   kMaxOutput = (ini[""]["max_output_per_task_mb"] | (kMaxRSS / 1024)) * 1024;
+  kMaxTrash = (ini[""]["max_trash_mb"] | (kMaxTrash / 1024)) * 1024;
   kMaxQueue = ini[""]["max_submission_queue_size"] | (kMaxParallel + 2);
+  kDownloadConcurrency = ini[""]["download_concurrency"] | kDownloadConcurrency;
+  kMaxTdPool = (ini[""]["max_testdata_mb"] | (kMaxTdPool / 1024)) * 1024;
+  kCompressTestdata = ini[""]["compress_testdata"] | kCompressTestdata;
   kTimeMultiplier = ini[""]["time_multiplier"] | kTimeMultiplier;
   kTIOJUrl = ini[""]["tioj_url"] | kTIOJUrl;
   kTIOJKey = ini[""]["tioj_key"] | kTIOJKey;
@@ -114,6 +122,10 @@ void ParseArgs(int argc, char** argv) {
       exit(1);
     }
   }
+  if (kSetupThreads < 1) {
+    spdlog::warn("setup_threads must be at least 1; using 1.");
+    kSetupThreads = 1;
+  }
   if (CPU_COUNT(&kPinnedCpus) && CPU_COUNT(&kPinnedCpus) < kMaxParallel) {
     spdlog::warn("Parallelism larger than the number of pinned CPUs. Some tasks may not be pinned.");
   }
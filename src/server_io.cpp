@@ -4,10 +4,13 @@
 #include <mutex>
 #include <chrono>
 #include <memory>
+#include <thread>
+#include <optional>
+#include <algorithm>
+#include <functional>
 #include <unordered_set>
 #include <condition_variable>
 
-#include <zstd.h>
 #include <httplib.h>
 #include <spdlog/fmt/bundled/core.h>
 #include <spdlog/fmt/bundled/ranges.h>
@@ -15,7 +18,9 @@
 
 #include "paths.h"
 #include "database.h"
+#include "td_pool.h"
 #include "websocket.h"
+#include "downloader.h"
 #include "http_utils.h"
 #include "tioj/paths.h"
 #include "tioj/utils.h"
@@ -23,6 +28,9 @@
 std::string kTIOJUrl = "";
 std::string kTIOJKey = "";
 size_t kMaxQueue = 20;
+int kDownloadConcurrency = 4;
+long kMaxTdPool = 0;
+bool kCompressTestdata = false;
 
 namespace {
 
@@ -35,11 +43,52 @@ fs::path TdPool() {
 fs::path TdPoolDir(long id) {
   return TdPool() / fmt::format("{:04d}", id / 100);
 }
-fs::path TdPoolPath(long id, bool is_input, bool is_temp) {
+fs::path TdPoolPath(long id, bool is_input, bool is_temp, bool compressed = false) {
   std::string name = fmt::format("{:06d}.{}", id, is_input ? "in" : "out");
+  if (compressed) name += ".zst";
   if (is_temp) name += ".tmp";
   return TdPoolDir(id) / name;
 }
+// decompressed copies of the testdata kept compressed in td-pool
+fs::path TdCache() {
+  return kTestdataRoot / "td-cache";
+}
+fs::path TdCacheDir(int problem_id) {
+  return TdCache() / fmt::format("{:04d}", problem_id);
+}
+fs::path TdCachePath(int problem_id, long id, bool is_input) {
+  return TdCacheDir(problem_id) / fmt::format("{:06d}.{}", id, is_input ? "in" : "out");
+}
+// what the symlinks in TdPath point to
+fs::path TdTarget(int problem_id, long id, bool is_input, bool compressed) {
+  return compressed ? TdCachePath(problem_id, id, is_input) : TdPoolPath(id, is_input, false);
+}
+
+// Point the links of a testdata position at the testdata; with td_file_lock held
+bool LinkPosition(int problem_id, int order, long testdata_id, bool input_compressed,
+                  bool output_compressed) {
+  auto input = TdTarget(problem_id, testdata_id, true, input_compressed);
+  auto output = TdTarget(problem_id, testdata_id, false, output_compressed);
+  return RetargetLink(TdInput(problem_id, order), input) &&
+         RetargetLink(TdAnswer(problem_id, order), output);
+}
+
+// whether a file sent compressed is kept compressed after downloading
+bool KeepCompressed(bool compressed) {
+  return kCompressTestdata && compressed;
+}
+// whether a file in td-pool is kept compressed; it may be so even if kCompressTestdata is unset now
+bool KeptCompressed(long id, bool is_input) {
+  return fs::exists(TdPoolPath(id, is_input, false, true));
+}
+
+// blobs of the content-addressed store (see td_pool.h); a blob is downloaded once as well
+fs::path TdBlobs() {
+  return TdPool() / "blobs";
+}
+fs::path TdBlobPath(const std::string& hash, bool compressed) {
+  return TdBlobs() / hash.substr(0, 2) / (compressed ? hash + ".zst" : hash);
+}
 
 inline double MonotonicTimestamp() {
   auto dur = std::chrono::steady_clock::now().time_since_epoch();
@@ -49,6 +98,123 @@ inline double MonotonicTimestamp() {
 /// --- database ---
 Database db;
 
+/// --- td-pool ---
+// transfers into td-pool, shared by all submissions
+TransferRegistry td_transfers;
+// decompressions into td-cache, shared likewise
+TransferRegistry td_caches;
+
+// problems referenced by submissions being prepared or judged
+ProblemRefs problem_refs;
+std::mutex td_pool_mtx; // for td_pool_evict_cv
+std::condition_variable td_pool_evict_cv; // wakes TdPoolLoop after downloads
+
+// Taken by DealOneSubmission before reading the testdata meta; once the submission is pushed,
+//  the reference is released by ReportFinalized instead
+// TestdataFetch holds its own until the database is updated, since the submission may be
+//  finalized (e.g. on CE) before its downloads end
+class ProblemRef {
+  int problem_id_;
+ public:
+  explicit ProblemRef(int problem_id) : problem_id_(problem_id) {
+    problem_refs.Ref(problem_id);
+  }
+  ~ProblemRef() {
+    if (problem_id_ != -1) problem_refs.Unref(problem_id_);
+  }
+  void Release() { problem_id_ = -1; }
+};
+
+// Remove the td-cache of problems not judged for idle_seconds; it is decompressed again when needed
+constexpr long kTdCacheIdleSeconds = 600;
+
+void DropIdleCaches(long idle_seconds) {
+  for (int problem_id : problem_refs.Idle(idle_seconds)) {
+    // referenced again in the meantime
+    if (!problem_refs.TryBeginEvict(problem_id)) continue;
+    if (fs::exists(TdCacheDir(problem_id))) {
+      for (auto& td : db.ProblemTd(problem_id)) td_caches.Forget(td.testdata_id);
+      RemoveAll(TdCacheDir(problem_id));
+      spdlog::info("Removed td-cache of problem {}", problem_id);
+    }
+    problem_refs.EndEvict();
+  }
+}
+
+// td-cache counts toward kMaxTdPool as well
+long TdUsage() {
+  return DiskUsage(TdPool()) + DiskUsage(TdCache());
+}
+
+// Remove the least recently used problems (testdata files, symlinks and database rows) until
+//  td-pool and td-cache fit in kMaxTdPool
+void EvictTdPool() {
+  if (kMaxTdPool <= 0) return;
+  if (TdUsage() <= kMaxTdPool * 1024) return;
+  // the caches of problems not being judged go first, since they are cheap to make again
+  DropIdleCaches(0);
+  std::unordered_map<int, std::pair<long, std::vector<long>>> problems; // -> (last used, testdata)
+  for (auto& td : db.AllTd()) {
+    auto& item = problems[td.problem_id];
+    item.first = std::max(item.first, td.last_used);
+    item.second.push_back(td.testdata_id);
+  }
+  std::vector<std::pair<long, int>> order;
+  for (auto& [problem_id, item] : problems) order.push_back({item.first, problem_id});
+  auto remove = [&](int problem_id) {
+    auto lck = td_file_lock.Exclusive(problem_id);
+    // rows first; if interrupted, the remaining files are downloaded again and overwritten
+    db.RemoveProblem(problem_id);
+    RemoveAll(TdPath(problem_id));
+    RemoveAll(TdCacheDir(problem_id));
+    std::error_code ec;
+    for (long testdata_id : problems[problem_id].second) {
+      td_transfers.Forget(testdata_id);
+      td_caches.Forget(testdata_id);
+      for (bool is_input : {true, false}) {
+        for (bool compressed : {false, true}) {
+          fs::remove(TdPoolPath(testdata_id, is_input, false, compressed), ec);
+        }
+      }
+    }
+  };
+  // blobs also used by other problems stay
+  EvictProblems(std::move(order), kMaxTdPool * 1024, problem_refs, TdBlobs(), TdUsage, remove);
+}
+
+void TdPoolLoop() {
+  while (true) {
+    {
+      std::unique_lock lck(td_pool_mtx);
+      td_pool_evict_cv.wait_for(lck, std::chrono::seconds(60));
+    }
+    // of replaced or deleted testdata
+    SweepBlobs(TdBlobs());
+    EvictTdPool();
+    DropIdleCaches(kTdCacheIdleSeconds);
+  }
+}
+
+// Decompress the files of a testdata kept compressed in td-pool into td-cache, once per version
+// No file lock is needed: the pool files are only replaced by renaming, and the problem is
+//  referenced by the caller so neither is removed
+bool CacheTestdata(int problem_id, long testdata_id, long timestamp) {
+  auto state = TransferRegistry::State::IN_FLIGHT;
+  while ((state = td_caches.TryBegin(testdata_id, timestamp)) == TransferRegistry::State::IN_FLIGHT) {
+    td_caches.Wait(testdata_id);
+  }
+  if (state == TransferRegistry::State::DONE) return true;
+  bool ok = CreateDirs(TdCacheDir(problem_id));
+  for (bool is_input : {true, false}) {
+    if (ok && KeptCompressed(testdata_id, is_input)) {
+      ok = DecompressFile(TdPoolPath(testdata_id, is_input, false, true),
+                          TdCachePath(problem_id, testdata_id, is_input));
+    }
+  }
+  td_caches.End(testdata_id, timestamp, ok);
+  return ok;
+}
+
 /// --- websocket client ---
 constexpr double kUniqueReqMinInterval = 0.5;
 
@@ -137,19 +303,30 @@ void ResendBackupRequests() {
 
 // judge requests
 std::mutex judge_mtx;
+size_t preparing_submissions = 0; // guarded by judge_mtx
 
 bool DealOneSubmission(nlohmann::json&& data);
 
 void OneSubmissionThread(nlohmann::json&& data) {
   int submission_id = data["submission_id"].get<int>();
-  std::lock_guard lck(judge_mtx);
-  // optionally reject submission here
-  if (CurrentSubmissionQueueSize() >= kMaxQueue) {
-    SendStatus(submission_id, "queued");
-    return;
-  }
-  if (CurrentSubmissionQueueSize() + 1 < kMaxQueue) TryFetchSubmission();
-  if (!DealOneSubmission(std::move(data))) {
+  {
+    std::lock_guard lck(judge_mtx);
+    size_t queue_size = CurrentSubmissionQueueSize() + preparing_submissions;
+    // optionally reject submission here
+    if (queue_size >= kMaxQueue) {
+      SendStatus(submission_id, "queued");
+      return;
+    }
+    if (queue_size + 1 < kMaxQueue) TryFetchSubmission();
+    preparing_submissions++;
+  }
+  // submissions are prepared concurrently; testdata downloads are shared through td_transfers
+  bool ok = DealOneSubmission(std::move(data));
+  {
+    std::lock_guard lck(judge_mtx);
+    preparing_submissions--;
+  }
+  if (!ok) {
     // send JE
     SendStatus(submission_id, VerdictToAbr(Verdict::JE));
     TryFetchSubmission();
@@ -267,51 +444,270 @@ Submission::Reporter server_reporter = {
   // no ReportCE/ERMessage; ReportOverallResult will send the message
   // we do this because it is possible that a submission gets both CE and ER message,
   //  so it is better to send it after completion
-  .ReportFinalized = [](const Submission&, const SubmissionResult&, size_t queue_size_before_pop) {
+  .ReportFinalized = [](const Submission& sub, const SubmissionResult&, size_t queue_size_before_pop) {
+    problem_refs.Unref(sub.problem_id);
     if (queue_size_before_pop == kMaxQueue) TryFetchSubmission();
   },
 };
 
 // --- helpers ---
-template <class Method, class... T>
-inline auto DownloadFile(const fs::path& path, bool compressed, T&&... params) {
-  std::ofstream fout;
-  auto Init = [&](){
-    if (fout.is_open()) fout.close();
-    fout.open(path);
+httplib::Params AddKey(httplib::Params&& params) {
+  params.insert({"key", kTIOJKey});
+  return params;
+}
+
+// download into temporary files and move them into td-pool; on_done(testdata_id, success) is
+//  called as soon as each testdata is in place, or for the remaining ones after a failure
+// Files whose blob is known (from the server) and present are linked instead of downloaded; the
+//  blobs of the downloaded ones are recorded into meta
+void DownloadTestdata(int problem_id, const std::vector<long>& testdata_ids,
+                      std::unordered_map<long, Testdata>& meta,
+                      const std::function<void(long, bool)>& on_done) {
+  // input & output of testdata_ids[i] are files 2i & 2i+1
+  auto Meta = [&](size_t file) -> Testdata& { return meta.at(testdata_ids[file / 2]); };
+  auto Blob = [&](size_t file) -> std::string& {
+    return file % 2 ? Meta(file).output_blob : Meta(file).input_blob;
+  };
+  auto Keep = [&](size_t file) {
+    return KeepCompressed(file % 2 ? Meta(file).output_compressed : Meta(file).input_compressed);
+  };
+  auto Temp = [&](size_t file) {
+    return TdPoolPath(testdata_ids[file / 2], file % 2 == 0, true, Keep(file));
   };
-  if (compressed) {
-    std::vector<uint8_t> bufOut(ZSTD_DStreamOutSize());
-    ZSTD_DCtx* const dctx = ZSTD_createDCtx();
-    auto reciever = [&](const char *data, size_t data_length) {
-      ZSTD_inBuffer input = {data, data_length, 0};
-      while (input.pos < input.size) {
-        ZSTD_outBuffer output = {bufOut.data(), bufOut.size(), 0};
-        const size_t ret = ZSTD_decompressStream(dctx, &output, &input);
-        if (ZSTD_isError(ret)) return false;
-        fout.write((char*)bufOut.data(), output.pos);
+
+  std::vector<Downloader::Item> items;
+  std::vector<size_t> item_files, adopted;
+  for (size_t i = 0; i < testdata_ids.size(); i++) {
+    long testdata_id = testdata_ids[i];
+    if (!CreateDirs(TdPoolDir(testdata_id))) {
+      for (long id : testdata_ids) on_done(id, false);
+      return;
+    }
+    for (size_t file : {2 * i, 2 * i + 1}) {
+      if (Blob(file).size() && AdoptBlob(TdBlobPath(Blob(file), Keep(file)), Temp(file))) {
+        adopted.push_back(file);
+        continue;
       }
-      return true;
-    };
-    auto ret = RequestRetryInit<Method>(
-        Init, std::forward<T>(params)..., reciever);
-    ZSTD_freeDCtx(dctx);
-    return ret;
-  } else {
-    auto reciever = [&fout](const char *data, size_t data_length) {
-      fout.write(data, data_length);
-      return true;
-    };
-    return RequestRetryInit<Method>(
-        Init, std::forward<T>(params)..., reciever);
+      httplib::Params params{{"tid", std::to_string(testdata_id)}};
+      if (file % 2 == 0) params.insert({"input", ""});
+      bool compressed = file % 2 ? Meta(file).output_compressed : Meta(file).input_compressed;
+      items.push_back({"/fetch/testdata", AddKey(std::move(params)), Temp(file), compressed, Keep(file)});
+      item_files.push_back(file);
+    }
   }
-}
+  std::vector<std::atomic_int> finished_files(testdata_ids.size());
+  std::vector<std::atomic_bool> failed(testdata_ids.size());
+  std::vector<std::atomic_bool> reported(testdata_ids.size());
+  auto FileDone = [&](size_t file, bool ok) {
+    size_t idx = file / 2;
+    if (!ok) failed[idx] = true;
+    if (++finished_files[idx] < 2) return;
+    long testdata_id = testdata_ids[idx];
+    ok = !failed[idx];
+    if (ok) {
+      auto lck = td_file_lock.Exclusive(problem_id);
+      std::error_code ec;
+      // rename & replace only, so it should be fast
+      // an older version kept the other way is removed once the links are moved to this one
+      for (size_t file : {2 * idx, 2 * idx + 1}) {
+        fs::rename(Temp(file), TdPoolPath(testdata_id, file % 2 == 0, false, Keep(file)), ec);
+        if (ec) break;
+      }
+      if (ec) ok = false;
+    }
+    reported[idx] = true;
+    on_done(testdata_id, ok);
+  };
+  if (adopted.size()) {
+    spdlog::info("Problem {}: {} testdata files found in td-pool", problem_id, adopted.size());
+  }
+  for (size_t file : adopted) FileDone(file, true);
 
-httplib::Params AddKey(httplib::Params&& params) {
-  params.insert({"key", kTIOJKey});
-  return params;
+  Downloader downloader(kTIOJUrl, kDownloadConcurrency);
+  auto ItemDone = [&](size_t idx) {
+    size_t file = item_files[idx];
+    const std::string& hash = downloader.Hash(idx);
+    bool ok = Blob(file).empty() || Blob(file) == hash;
+    if (!ok) {
+      spdlog::warn("Testdata {} {}: hash mismatch (expected {}, got {})", testdata_ids[file / 2],
+                   file % 2 ? "output" : "input", Blob(file), hash);
+    }
+    Blob(file) = hash;
+    FileDone(file, ok && LinkBlob(Temp(file), TdBlobPath(hash, Keep(file))));
+  };
+  if (downloader.Run(items, ItemDone)) return;
+  for (size_t i = 0; i < testdata_ids.size(); i++) {
+    if (!reported[i]) on_done(testdata_ids[i], false);
+  }
 }
 
+// Testdata downloads and decompressions (into td-cache) of one submission, which continue in the
+//  background while it is compiled and judged; its FETCH_TESTDATA tasks complete as the testdata
+//  becomes ready
+// The links of a position are moved to its new testdata only once that is in place, so that the
+//  submissions judging the old testdata meanwhile are not affected; the testdata meta in the
+//  database is updated only after all downloads are in place
+class TestdataFetch : public std::enable_shared_from_this<TestdataFetch> {
+  std::mutex mtx_;
+  int problem_id_;
+  std::unordered_map<long, Testdata> meta_;
+  std::unordered_set<long> to_download_, to_decompress_;
+  std::unordered_map<long, std::vector<int>> positions_; // to link to each testdata
+  std::unordered_map<long, std::pair<bool, bool>> compressed_; // (input, output) read from td-cache
+  std::unordered_map<long, std::optional<bool>> results_; // unset if not finished yet
+  std::unordered_map<long, std::vector<std::function<void(bool)>>> waiters_;
+  size_t remaining_;
+  bool failed_;
+  std::optional<ProblemRef> problem_ref_; // released after the last testdata
+
+  // the testdata is in place (downloaded and decompressed)
+  bool Link(long testdata_id) {
+    bool downloaded = to_download_.count(testdata_id);
+    auto it = positions_.find(testdata_id);
+    if (!downloaded && it == positions_.end()) return true;
+    auto [input, output] = compressed_.at(testdata_id);
+    auto lck = td_file_lock.Exclusive(problem_id_);
+    if (it != positions_.end()) {
+      for (int order : it->second) {
+        if (!LinkPosition(problem_id_, order, testdata_id, input, output)) return false;
+      }
+    }
+    if (downloaded) {
+      // an older version kept the other way; nothing links to it any more
+      std::error_code ec;
+      for (bool is_input : {true, false}) {
+        bool keep = is_input ? input : output;
+        fs::remove(TdPoolPath(testdata_id, is_input, false, !keep), ec);
+        if (!keep) fs::remove(TdCachePath(problem_id_, testdata_id, is_input), ec);
+      }
+    }
+    return true;
+  }
+
+  void Finish(long testdata_id, bool ok) {
+    if (ok) ok = Link(testdata_id);
+    std::vector<std::function<void(bool)>> waiters;
+    bool last = false, update_db = false;
+    {
+      std::lock_guard lck(mtx_);
+      results_[testdata_id] = ok;
+      if (!ok) failed_ = true;
+      last = --remaining_ == 0;
+      update_db = last && !failed_ && to_download_.size();
+      if (auto it = waiters_.find(testdata_id); it != waiters_.end()) {
+        waiters = std::move(it->second);
+        waiters_.erase(it);
+      }
+    }
+    for (auto& done : waiters) done(ok);
+    if (update_db) {
+      std::vector<Testdata> new_td;
+      for (auto& i : meta_) new_td.push_back(i.second);
+      db.UpdateTd(new_td);
+      spdlog::info("Testdata of problem {} updated", problem_id_);
+    }
+    if (last) {
+      // it may be evicted from now on
+      problem_ref_.reset();
+      td_pool_evict_cv.notify_one();
+    }
+  }
+
+  // the testdata is in td-pool
+  void Ready(long testdata_id, bool ok) {
+    if (ok && to_decompress_.count(testdata_id)) {
+      ok = CacheTestdata(problem_id_, testdata_id, meta_.at(testdata_id).timestamp);
+      // probably a broken file; download it again next time
+      if (!ok) td_transfers.Forget(testdata_id);
+    }
+    Finish(testdata_id, ok);
+  }
+
+  void Download(const std::vector<long>& testdata_ids) {
+    DownloadTestdata(problem_id_, testdata_ids, meta_, [this](long testdata_id, bool ok) {
+      td_transfers.End(testdata_id, meta_.at(testdata_id).timestamp, ok);
+      Ready(testdata_id, ok);
+    });
+  }
+
+  // testdata being downloaded by other submissions; take over the ones that failed there
+  void WaitOthers(const std::vector<long>& testdata_ids) {
+    for (long testdata_id : testdata_ids) {
+      long timestamp = meta_.at(testdata_id).timestamp;
+      auto state = TransferRegistry::State::IN_FLIGHT;
+      for (; state == TransferRegistry::State::IN_FLIGHT; state = td_transfers.TryBegin(testdata_id, timestamp)) {
+        td_transfers.Wait(testdata_id);
+      }
+      if (state == TransferRegistry::State::DONE) {
+        Ready(testdata_id, true);
+      } else {
+        Download({testdata_id});
+      }
+    }
+  }
+
+ public:
+  TestdataFetch(int problem_id, const std::unordered_map<long, Testdata>& meta,
+                const std::vector<long>& to_download, const std::vector<long>& to_decompress,
+                const std::unordered_map<long, std::vector<int>>& positions,
+                const std::unordered_map<long, std::pair<bool, bool>>& compressed) :
+      problem_id_(problem_id), meta_(meta), to_download_(to_download.begin(), to_download.end()),
+      to_decompress_(to_decompress.begin(), to_decompress.end()), positions_(positions),
+      compressed_(compressed), failed_(false) {
+    problem_ref_.emplace(problem_id);
+    for (long testdata_id : to_download) results_[testdata_id] = std::nullopt;
+    for (long testdata_id : to_decompress) results_[testdata_id] = std::nullopt;
+    remaining_ = results_.size();
+  }
+
+  void Start() {
+    std::vector<long> owned, waiting, finished;
+    for (auto& [testdata_id, result] : results_) {
+      if (!to_download_.count(testdata_id)) {
+        finished.push_back(testdata_id);
+        continue;
+      }
+      switch (td_transfers.TryBegin(testdata_id, meta_.at(testdata_id).timestamp)) {
+        case TransferRegistry::State::OWNER: owned.push_back(testdata_id); break;
+        case TransferRegistry::State::IN_FLIGHT: waiting.push_back(testdata_id); break;
+        case TransferRegistry::State::DONE: finished.push_back(testdata_id); break;
+      }
+    }
+    // in testdata order, so that the first testdata can run first
+    auto ByOrder = [this](long a, long b) { return meta_.at(a).order < meta_.at(b).order; };
+    std::sort(owned.begin(), owned.end(), ByOrder);
+    std::sort(waiting.begin(), waiting.end(), ByOrder);
+    std::sort(finished.begin(), finished.end(), ByOrder);
+    if (waiting.size()) {
+      spdlog::info("Problem {}: waiting for {} testdata downloaded by other submissions",
+                   problem_id_, waiting.size());
+    }
+    auto self = shared_from_this();
+    if (owned.size()) std::thread([self, owned]() { self->Download(owned); }).detach();
+    if (waiting.size()) std::thread([self, waiting]() { self->WaitOthers(waiting); }).detach();
+    // in td-pool already; decompressing may take a while
+    if (finished.size()) {
+      std::thread([self, finished]() {
+        for (long testdata_id : finished) self->Ready(testdata_id, true);
+      }).detach();
+    }
+  }
+
+  // call done(success) once the testdata is in place
+  void Request(long testdata_id, std::function<void(bool)>&& done) {
+    std::optional<bool> result = true; // neither downloaded nor decompressed
+    {
+      std::lock_guard lck(mtx_);
+      if (auto it = results_.find(testdata_id); it != results_.end()) result = it->second;
+      if (!result) {
+        waiters_[testdata_id].push_back(std::move(done));
+        return;
+      }
+    }
+    done(*result);
+  }
+};
+
 class TempDirectory { // RAII tempdir
   fs::path path_;
  public:
@@ -369,10 +765,10 @@ bool DealOneSubmission(nlohmann::json&& data) {
   using namespace sqlite_orm;
   using nlohmann::json;
 
-  Client cli(kTIOJUrl);
   db.Init();
 
   Submission sub;
+  std::optional<ProblemRef> problem_ref;
   TempDirectory tempdir;
   if (tempdir.Path().empty()) return false;
 
@@ -404,6 +800,7 @@ bool DealOneSubmission(nlohmann::json&& data) {
     // problem information
     auto& problem = data["problem"];
     sub.problem_id = problem["id"].get<int>();
+    problem_ref.emplace(sub.problem_id);
     sub.sandbox_strict = problem["strict_mode"].get<bool>();
     sub.stages = problem["num_stages"].get<int>();
     sub.specjudge_type = (SpecjudgeType)problem["specjudge_type"].get<int>();
@@ -432,6 +829,7 @@ bool DealOneSubmission(nlohmann::json&& data) {
     td_count = td.size();
     {
       std::unordered_map<long, Testdata> orig_td;
+      long now = time(nullptr);
       for (auto& i : db.ProblemTd(sub.problem_id)) {
         orig_td[i.testdata_id] = i;
         if (i.order >= orig_td_count) orig_td_count = i.order + 1;
@@ -444,13 +842,22 @@ bool DealOneSubmission(nlohmann::json&& data) {
         td.timestamp = td_item["updated_at"].get<long>();
         td.input_compressed = td_item.value("input_compressed", false);
         td.output_compressed = td_item.value("output_compressed", false);
+        // SHA-256 of the decompressed files, if the server knows them
+        td.input_blob = td_item.value("input_sha256", "");
+        td.output_blob = td_item.value("output_sha256", "");
         td.order = i;
         td.problem_id = sub.problem_id;
+        td.last_used = now;
         auto it = orig_td.find(td.testdata_id);
-        if (it == orig_td.end() || it->second.timestamp != td.timestamp) {
+        bool download = it == orig_td.end() || it->second.timestamp != td.timestamp;
+        if (download) {
           to_download.push_back(td.testdata_id);
+        } else {
+          if (td.input_blob.empty()) td.input_blob = it->second.input_blob;
+          if (td.output_blob.empty()) td.output_blob = it->second.output_blob;
         }
-        if (it == orig_td.end() || it->second.order != i) {
+        // a new version may be kept compressed or not unlike the old one, so relink it as well
+        if (download || it->second.order != i) {
           to_update_position.push_back({i, td.testdata_id});
         }
         new_meta.insert({td.testdata_id, td});
@@ -492,47 +899,46 @@ bool DealOneSubmission(nlohmann::json&& data) {
     spdlog::warn("Submission parsing error: {}", err.what());
     return false;
   }
-  // download testdata
-  for (long testdata_id : to_download) {
-    if (!CreateDirs(TdPoolDir(testdata_id))) return false;
-    const Testdata& td = new_meta.at(testdata_id);
-    // input
-    auto res = DownloadFile<HTTPGet>(TdPoolPath(testdata_id, true, true),
-        td.input_compressed, cli, "/fetch/testdata",
-        AddKey({{"tid", std::to_string(testdata_id)}, {"input", ""}}), Headers());
-    if (!IsSuccess(res)) return false;
-    // output
-    res = DownloadFile<HTTPGet>(TdPoolPath(testdata_id, false, true),
-        td.output_compressed, cli, "/fetch/testdata",
-        AddKey({{"tid", std::to_string(testdata_id)}}), Headers());
-    if (!IsSuccess(res)) return false;
-  }
-  // update symlinks
+  // files kept compressed in td-pool are read from td-cache
+  std::vector<long> to_decompress;
+  std::unordered_map<long, std::pair<bool, bool>> compressed; // (input, output)
   {
-    std::lock_guard lck(td_file_lock[sub.problem_id]);
-    std::error_code ec;
-    for (long testdata_id : to_download) {
-      // rename & replace only, so it should be fast
-      fs::rename(TdPoolPath(testdata_id, true, true), TdPoolPath(testdata_id, true, false), ec);
-      if (ec) return false;
-      fs::rename(TdPoolPath(testdata_id, false, true), TdPoolPath(testdata_id, false, false), ec);
-      if (ec) return false;
+    std::unordered_set<long> downloading(to_download.begin(), to_download.end());
+    for (auto& [testdata_id, td] : new_meta) {
+      auto& [input, output] = compressed[testdata_id];
+      if (downloading.count(testdata_id)) {
+        input = KeepCompressed(td.input_compressed);
+        output = KeepCompressed(td.output_compressed);
+      } else {
+        input = KeptCompressed(testdata_id, true);
+        output = KeptCompressed(testdata_id, false);
+      }
+      if (input || output) to_decompress.push_back(testdata_id);
     }
+  }
+  // update symlinks; the positions of testdata to be downloaded or decompressed are linked by
+  //  TestdataFetch once it is in place
+  std::unordered_map<long, std::vector<int>> pending_positions;
+  {
+    std::unordered_set<long> pending(to_download.begin(), to_download.end());
+    pending.insert(to_decompress.begin(), to_decompress.end());
+    auto lck = td_file_lock.Exclusive(sub.problem_id);
+    std::error_code ec;
     for (long testdata_id : to_delete) {
-      fs::remove(TdPoolPath(testdata_id, true, false), ec);
-      fs::remove(TdPoolPath(testdata_id, false, false), ec);
+      for (bool is_input : {true, false}) {
+        fs::remove(TdPoolPath(testdata_id, is_input, false), ec);
+        fs::remove(TdPoolPath(testdata_id, is_input, false, true), ec);
+        fs::remove(TdCachePath(sub.problem_id, testdata_id, is_input), ec);
+      }
     }
     CreateDirs(TdPath(sub.problem_id));
     for (auto [order, testdata_id] : to_update_position) {
-      auto target_in = TdInput(sub.problem_id, order);
-      auto target_out = TdAnswer(sub.problem_id, order);
-      // ignore error (might not exist)
-      fs::remove(target_in, ec);
-      fs::remove(target_out, ec);
-      fs::create_symlink(TdPoolPath(testdata_id, true, false), target_in, ec);
-      if (ec) return false;
-      fs::create_symlink(TdPoolPath(testdata_id, false, false), target_out, ec);
-      if (ec) return false;
+      if (pending.count(testdata_id)) {
+        pending_positions[testdata_id].push_back(order);
+        continue;
+      }
+      auto [input, output] = compressed[testdata_id];
+      if (!LinkPosition(sub.problem_id, order, testdata_id, input, output)) return false;
     }
     // old symlinks
     for (int i = td_count; i < orig_td_count; i++) {
@@ -540,12 +946,24 @@ bool DealOneSubmission(nlohmann::json&& data) {
       fs::remove(TdAnswer(sub.problem_id, i), ec);
     }
   }
-  // update database meta
-  {
+  // download (and decompress) testdata in the background; the testdata of submissions prepared at
+  //  the same time is downloaded only once
+  if (to_download.empty()) {
     std::vector<Testdata> new_td;
     for (auto& i : new_meta) new_td.push_back(i.second);
     db.UpdateTd(new_td);
   }
+  if (to_download.size() || to_decompress.size()) {
+    auto fetch = std::make_shared<TestdataFetch>(sub.problem_id, new_meta, to_download, to_decompress,
+                                                 pending_positions, compressed);
+    fetch->Start();
+    std::vector<long> td_ids(td_count);
+    for (auto& i : new_meta) td_ids[i.second.order] = i.first;
+    sub.fetch_testdata = [fetch, td_ids = std::move(td_ids)](
+        const Submission&, int subtask, std::function<void(bool)> done) {
+      fetch->Request(td_ids[subtask], std::move(done));
+    };
+  }
   // finalize & push
   sub.submission_internal_id = GetUniqueSubmissionInternalId();
   sub.reporter = server_reporter;
@@ -563,6 +981,7 @@ bool DealOneSubmission(nlohmann::json&& data) {
     Move(tempdir.SummaryPath(), SubmissionSummaryCode(sub.submission_internal_id));
   }
   PushSubmission(std::move(sub));
+  problem_ref->Release();
   return true;
 }
 
@@ -671,8 +1090,13 @@ void ServerWorkLoop() {
   // main thread: send current received submissions
   // thread 2: RequestLoop (send all outgoing requests via queue)
   // thread 3...: WsClient (created by RequestLoop)
+  // another thread: TdPoolLoop (evict testdata of unused problems if kMaxTdPool is set; remove idle
+  //  td-cache)
+  // td-cache is not tracked across restarts
+  RemoveAll(TdCache());
   std::thread thr(RequestLoop);
   thr.detach();
+  std::thread(TdPoolLoop).detach();
   int empty_cnt = 0;
   while (true) {
     std::this_thread::sleep_for(std::chrono::duration<double>(10));
@@ -8,6 +8,13 @@ const std::string kVersionCode = "2.1.3";
 extern std::string kTIOJUrl;
 extern std::string kTIOJKey;
 extern size_t kMaxQueue;
+// number of testdata files downloaded at the same time
+extern int kDownloadConcurrency;
+// KiB; the least recently used problems are removed from td-pool above this size (td-pool and
+//  td-cache together); 0 = unlimited
+extern long kMaxTdPool;
+// keep testdata sent compressed as is in td-pool, and decompress it into td-cache when judged
+extern bool kCompressTestdata;
 
 // Note that we also need to add some work balancing on webserver in case of multiple clients,
 //   because now they will try to greedily fetch submissions to judge them in parallel
@@ -0,0 +1,129 @@
+#include "td_pool.h"
+
+#include <unistd.h>
+#include <sys/stat.h>
+#include <ctime>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+
+#include <spdlog/spdlog.h>
+
+#include "tioj/utils.h"
+
+bool AdoptBlob(const fs::path& blob, const fs::path& file) {
+  unlink(file.c_str());
+  return link(blob.c_str(), file.c_str()) == 0;
+}
+
+bool LinkBlob(const fs::path& file, const fs::path& blob) {
+  if (!CreateDirs(blob.parent_path())) return false;
+  fs::path temp = file;
+  temp += ".link";
+  // the existing blob may be swept in the meantime; then try again
+  for (int tries = 0; tries < 2; tries++) {
+    if (link(file.c_str(), blob.c_str()) == 0) return true;
+    if (errno != EEXIST) break;
+    if (AdoptBlob(blob, temp)) {
+      std::error_code ec;
+      fs::rename(temp, file, ec);
+      return !ec;
+    }
+    if (errno != ENOENT) break;
+  }
+  spdlog::warn("Failed linking {} as {}: {}", file.c_str(), blob.c_str(), strerror(errno));
+  return false;
+}
+
+void SweepBlobs(const fs::path& blobs) {
+  std::vector<fs::path> unused;
+  std::error_code ec;
+  for (auto it = fs::recursive_directory_iterator(blobs, ec);
+       !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+    struct stat st;
+    if (lstat(it->path().c_str(), &st) == 0 && S_ISREG(st.st_mode) && st.st_nlink == 1) {
+      unused.push_back(it->path());
+    }
+  }
+  for (auto& path : unused) fs::remove(path, ec);
+  if (unused.size()) spdlog::info("Removed {} unused blobs from td-pool", unused.size());
+}
+
+bool RetargetLink(const fs::path& link, const fs::path& target) {
+  fs::path temp = link;
+  temp += ".new";
+  std::error_code ec;
+  fs::remove(temp, ec);
+  fs::create_symlink(target, temp, ec);
+  if (!ec) fs::rename(temp, link, ec);
+  if (ec) {
+    spdlog::warn("Failed linking {} to {}: {}", link.c_str(), target.c_str(), ec.message());
+    fs::remove(temp, ec);
+    return false;
+  }
+  return true;
+}
+
+void ProblemRefs::Ref(int problem_id) {
+  std::unique_lock lck(mtx_);
+  cv_.wait(lck, [&]{ return evicting_ != problem_id; });
+  refs_[problem_id]++;
+  idle_since_.erase(problem_id);
+}
+
+void ProblemRefs::Unref(int problem_id) {
+  std::lock_guard lck(mtx_);
+  if (!--refs_[problem_id]) {
+    refs_.erase(problem_id);
+    idle_since_[problem_id] = time(nullptr);
+  }
+}
+
+std::vector<int> ProblemRefs::Idle(long seconds) {
+  long now = time(nullptr);
+  std::vector<int> ret;
+  std::lock_guard lck(mtx_);
+  for (auto& [problem_id, since] : idle_since_) {
+    if (now - since >= seconds) ret.push_back(problem_id);
+  }
+  return ret;
+}
+
+bool ProblemRefs::TryBeginEvict(int problem_id) {
+  std::lock_guard lck(mtx_);
+  if (refs_.count(problem_id)) return false;
+  // what is left of it is made again on the next reference
+  idle_since_.erase(problem_id);
+  evicting_ = problem_id;
+  return true;
+}
+
+void ProblemRefs::EndEvict() {
+  {
+    std::lock_guard lck(mtx_);
+    evicting_ = -1;
+  }
+  cv_.notify_all();
+}
+
+std::vector<int> EvictProblems(std::vector<std::pair<long, int>> order, long budget,
+                               ProblemRefs& refs, const fs::path& blobs,
+                               const std::function<long()>& usage,
+                               const std::function<void(int)>& remove) {
+  std::vector<int> evicted;
+  long current = usage();
+  std::sort(order.begin(), order.end());
+  for (auto [last_used, problem_id] : order) {
+    if (current <= budget) break;
+    if (!refs.TryBeginEvict(problem_id)) continue;
+    remove(problem_id);
+    SweepBlobs(blobs);
+    long new_usage = usage();
+    spdlog::info("Evicted testdata of problem {}: last_used={} freed={} pool_usage={}",
+                 problem_id, last_used, current - new_usage, new_usage);
+    current = new_usage;
+    refs.EndEvict();
+    evicted.push_back(problem_id);
+  }
+  return evicted;
+}
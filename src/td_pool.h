@@ -0,0 +1,64 @@
+#ifndef TD_POOL_H_
+#define TD_POOL_H_
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include <utility>
+#include <filesystem>
+#include <functional>
+#include <unordered_map>
+#include <condition_variable>
+
+namespace fs = std::filesystem;
+
+// Content-addressed store of the testdata: each file in td-pool is a hard link of the blob named by
+//  the hash of its content, so a file used by several testdata (of any problem) is stored once; the
+//  link count of a blob is one more than the number of its users
+
+// Link an existing blob as `file`; false if there is none
+bool AdoptBlob(const fs::path& blob, const fs::path& file);
+// Make `file`, a downloaded file, a link of its blob: it becomes the blob, or is replaced by the
+//  existing one
+bool LinkBlob(const fs::path& file, const fs::path& blob);
+// Remove the blobs under `blobs` no longer used by any testdata
+// One being adopted at the same time may still be removed; the new link keeps the content, which
+//  is just not shared afterwards
+void SweepBlobs(const fs::path& blobs);
+
+// Point the symlink `link` at `target`; the link is replaced by renaming, so that a reader never
+//  finds it missing
+bool RetargetLink(const fs::path& link, const fs::path& target);
+
+// References to problems by submissions being prepared or judged; a referenced problem is never
+//  evicted, and referencing a problem being evicted waits until it is done
+class ProblemRefs {
+ public:
+  void Ref(int problem_id);
+  void Unref(int problem_id);
+  // unreferenced problems that have not been referenced for at least `seconds` since they were
+  //  last released
+  std::vector<int> Idle(long seconds);
+  // false if the problem is referenced; otherwise Ref on it blocks until EndEvict
+  bool TryBeginEvict(int problem_id);
+  void EndEvict();
+
+ private:
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::unordered_map<int, int> refs_;
+  std::unordered_map<int, long> idle_since_; // UNIX timestamp
+  int evicting_ = -1;
+};
+
+// Remove the least recently used problems until usage() (bytes) is at most `budget`, skipping
+//  the referenced ones; `order` lists (last used, problem id) of the problems in td-pool
+// remove(problem_id) removes the files of a problem, after which the blobs no longer used are
+//  swept; the ones shared with other problems stay
+// Returns the evicted problems in the order evicted
+std::vector<int> EvictProblems(std::vector<std::pair<long, int>> order, long budget,
+                               ProblemRefs& refs, const fs::path& blobs,
+                               const std::function<long()>& usage,
+                               const std::function<void(int)>& remove);
+
+#endif  // TD_POOL_H_
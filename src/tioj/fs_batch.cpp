@@ -0,0 +1,281 @@
+#include "fs_batch.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <climits>
+#include <cstring>
+#include <algorithm>
+
+#include <spdlog/spdlog.h>
+
+#include "utils.h"
+
+namespace {
+
+constexpr int kPending = INT_MIN;
+
+// A minimal io_uring instance, set up once per thread
+class Ring {
+  int fd_ = -1;
+  void* ring_ = MAP_FAILED;
+  size_t ring_len_ = 0;
+  struct io_uring_sqe* sqes_ = (struct io_uring_sqe*)MAP_FAILED;
+  size_t sqes_len_ = 0;
+  unsigned *sq_head_, *sq_tail_, *sq_mask_, *sq_array_;
+  unsigned *cq_head_, *cq_tail_, *cq_mask_;
+  struct io_uring_cqe* cqes_;
+
+  void Close() {
+    if (sqes_ != MAP_FAILED) munmap(sqes_, sqes_len_);
+    if (ring_ != MAP_FAILED) munmap(ring_, ring_len_);
+    if (fd_ >= 0) close(fd_);
+    sqes_ = (struct io_uring_sqe*)MAP_FAILED;
+    ring_ = MAP_FAILED;
+    fd_ = -1;
+  }
+ public:
+  static constexpr unsigned kEntries = 64;
+
+  Ring() {
+    struct io_uring_params params = {};
+    fd_ = syscall(SYS_io_uring_setup, kEntries, &params);
+    if (fd_ < 0) {
+      spdlog::info("io_uring not available, filesystem operations are not batched: {}", strerror(errno));
+      return;
+    }
+    // the operations used are available since 5.15, so the rings are always mapped together
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) goto unsupported;
+    ring_len_ = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                         params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe));
+    ring_ = mmap(nullptr, ring_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    sqes_len_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    sqes_ = (struct io_uring_sqe*)mmap(nullptr, sqes_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                       fd_, IORING_OFF_SQES);
+    if (ring_ == MAP_FAILED || sqes_ == MAP_FAILED) goto unsupported;
+    {
+      char* base = (char*)ring_;
+      sq_head_ = (unsigned*)(base + params.sq_off.head);
+      sq_tail_ = (unsigned*)(base + params.sq_off.tail);
+      sq_mask_ = (unsigned*)(base + params.sq_off.ring_mask);
+      sq_array_ = (unsigned*)(base + params.sq_off.array);
+      cq_head_ = (unsigned*)(base + params.cq_off.head);
+      cq_tail_ = (unsigned*)(base + params.cq_off.tail);
+      cq_mask_ = (unsigned*)(base + params.cq_off.ring_mask);
+      cqes_ = (struct io_uring_cqe*)(base + params.cq_off.cqes);
+      constexpr unsigned kProbeOps = 256;
+      std::vector<char> buf(sizeof(struct io_uring_probe) + kProbeOps * sizeof(struct io_uring_probe_op));
+      auto probe = (struct io_uring_probe*)buf.data();
+      if (syscall(SYS_io_uring_register, fd_, IORING_REGISTER_PROBE, probe, kProbeOps) < 0) goto unsupported;
+      for (int op : {IORING_OP_MKDIRAT, IORING_OP_OPENAT, IORING_OP_LINKAT, IORING_OP_SYMLINKAT,
+                     IORING_OP_RENAMEAT, IORING_OP_UNLINKAT}) {
+        if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) goto unsupported;
+      }
+    }
+    return;
+unsupported:
+    spdlog::info("io_uring does not support the required operations, filesystem operations are not batched");
+    Close();
+  }
+  ~Ring() { Close(); }
+  Ring(const Ring&) = delete;
+  Ring& operator=(const Ring&) = delete;
+
+  bool Ok() const { return fd_ >= 0; }
+
+  // the i-th entry of the next submission, cleared
+  struct io_uring_sqe* Sqe(unsigned i) {
+    unsigned idx = (*sq_tail_ + i) & *sq_mask_;
+    sq_array_[idx] = idx;
+    memset(&sqes_[idx], 0, sizeof(struct io_uring_sqe));
+    return &sqes_[idx];
+  }
+
+  // submit n entries prepared by Sqe and wait for all of their completions
+  template <class Func> bool SubmitAndWait(unsigned n, Func&& on_complete) {
+    __atomic_store_n(sq_tail_, *sq_tail_ + n, __ATOMIC_RELEASE);
+    for (unsigned done = 0; done < n;) {
+      unsigned to_submit = *sq_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+      if (syscall(SYS_io_uring_enter, fd_, to_submit, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 &&
+          errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        spdlog::warn("Failed submitting to io_uring: {}", strerror(errno));
+        Close();
+        return false;
+      }
+      unsigned head = *cq_head_, tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+      for (; head != tail; head++, done++) {
+        auto& cqe = cqes_[head & *cq_mask_];
+        on_complete(cqe.user_data, cqe.res);
+      }
+      __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+    return true;
+  }
+};
+
+inline mode_t Mode(fs::perms perms) {
+  return (mode_t)(perms & fs::perms::mask);
+}
+
+} // namespace
+
+size_t FsBatch::Push(Op op, const fs::path& path, const fs::path& path2, fs::perms perms) {
+  ops_.push_back({op, path, path2, perms, kPending});
+  return ops_.size() - 1;
+}
+
+size_t FsBatch::Mkdir(const fs::path& path, fs::perms perms) {
+  return Push(Op::MKDIR, path, {}, perms);
+}
+size_t FsBatch::Create(const fs::path& path, fs::perms perms) {
+  return Push(Op::CREATE, path, {}, perms);
+}
+size_t FsBatch::Link(const fs::path& from, const fs::path& to) {
+  return Push(Op::LINK, from, to);
+}
+size_t FsBatch::Symlink(const fs::path& target, const fs::path& link) {
+  return Push(Op::SYMLINK, target, link);
+}
+size_t FsBatch::Rename(const fs::path& from, const fs::path& to, fs::perms perms) {
+  return Push(Op::RENAME, from, to, perms);
+}
+size_t FsBatch::Unlink(const fs::path& path) {
+  return Push(Op::UNLINK, path);
+}
+size_t FsBatch::Rmdir(const fs::path& path) {
+  return Push(Op::RMDIR, path);
+}
+
+bool FsBatch::RunIoUring() {
+  thread_local Ring ring;
+  if (!ring.Ok()) return false;
+  for (size_t start = 0; start < ops_.size(); start += Ring::kEntries) {
+    unsigned num = std::min(ops_.size() - start, (size_t)Ring::kEntries);
+    for (unsigned i = 0; i < num; i++) {
+      const Entry& entry = ops_[start + i];
+      auto sqe = ring.Sqe(i);
+      sqe->fd = AT_FDCWD;
+      sqe->addr = (uintptr_t)entry.path.c_str();
+      sqe->user_data = start + i;
+      // keep the order; a hard link does not cancel the rest on failure
+      if (i + 1 < num) sqe->flags = IOSQE_IO_HARDLINK;
+      switch (entry.op) {
+        case Op::MKDIR:
+          sqe->opcode = IORING_OP_MKDIRAT;
+          sqe->len = 0777;
+          break;
+        case Op::CREATE:
+          sqe->opcode = IORING_OP_OPENAT;
+          sqe->len = Mode(entry.perms);
+          sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+          break;
+        case Op::LINK:
+          sqe->opcode = IORING_OP_LINKAT;
+          sqe->len = AT_FDCWD;
+          sqe->addr2 = (uintptr_t)entry.path2.c_str();
+          break;
+        case Op::SYMLINK:
+          sqe->opcode = IORING_OP_SYMLINKAT;
+          sqe->addr2 = (uintptr_t)entry.path2.c_str();
+          break;
+        case Op::RENAME:
+          sqe->opcode = IORING_OP_RENAMEAT;
+          sqe->len = AT_FDCWD;
+          sqe->addr2 = (uintptr_t)entry.path2.c_str();
+          break;
+        case Op::UNLINK: [[fallthrough]];
+        case Op::RMDIR:
+          sqe->opcode = IORING_OP_UNLINKAT;
+          sqe->unlink_flags = entry.op == Op::RMDIR ? AT_REMOVEDIR : 0;
+          break;
+      }
+    }
+    if (!ring.SubmitAndWait(num, [&](uint64_t index, int res) { ops_[index].res = res; })) return false;
+  }
+  return true;
+}
+
+bool FsBatch::Finish(Entry& entry) {
+  const char* name = "";
+  switch (entry.op) {
+    case Op::MKDIR:
+      name = "creating directory";
+      if (entry.res == -EEXIST && fs::is_directory(entry.path)) entry.res = 0;
+      if (entry.res == 0 && entry.perms != fs::perms::unknown && chmod(entry.path.c_str(), Mode(entry.perms)) < 0) {
+        entry.res = -errno;
+      }
+      break;
+    case Op::CREATE:
+      name = "creating file";
+      if (entry.res >= 0) {
+        int fd = entry.res;
+        entry.res = fchmod(fd, Mode(entry.perms)) < 0 ? -errno : 0;
+        close(fd);
+      }
+      break;
+    case Op::LINK:
+      name = "linking";
+      // Copy logs the failure itself
+      if (entry.res == -EXDEV) {
+        entry.res = Copy(entry.path, entry.path2, fs::status(entry.path).permissions()) ? 0 : -EXDEV;
+        return entry.res == 0;
+      }
+      break;
+    case Op::SYMLINK:
+      name = "creating symlink";
+      break;
+    case Op::RENAME:
+      name = "moving";
+      if (entry.res == 0 && entry.perms != fs::perms::unknown && chmod(entry.path2.c_str(), Mode(entry.perms)) < 0) {
+        entry.res = -errno;
+      }
+      break;
+    case Op::UNLINK:
+      name = "deleting";
+      if (entry.res == -ENOENT) entry.res = 0;
+      break;
+    case Op::RMDIR:
+      name = "deleting directory";
+      break;
+  }
+  if (entry.res >= 0) return true;
+  if (entry.path2.empty()) {
+    spdlog::warn("Failed {} {}: {}", name, entry.path.c_str(), strerror(-entry.res));
+  } else {
+    spdlog::warn("Failed {} {} -> {}: {}", name, entry.path.c_str(), entry.path2.c_str(), strerror(-entry.res));
+  }
+  return false;
+}
+
+bool FsBatch::Run() {
+  spdlog::debug("Run {} filesystem operations", ops_.size());
+  // operations not completed by io_uring (if it fails halfway) are also done here
+  if (!use_io_uring_ || !RunIoUring()) {
+    for (auto& entry : ops_) {
+      if (entry.res != kPending) continue;
+      const char* path = entry.path.c_str();
+      const char* path2 = entry.path2.c_str();
+      int ret = 0;
+      switch (entry.op) {
+        case Op::MKDIR: ret = mkdir(path, 0777); break;
+        case Op::CREATE: ret = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, Mode(entry.perms)); break;
+        case Op::LINK: ret = link(path, path2); break;
+        case Op::SYMLINK: ret = symlink(path, path2); break;
+        case Op::RENAME: ret = rename(path, path2); break;
+        case Op::UNLINK: ret = unlink(path); break;
+        case Op::RMDIR: ret = rmdir(path); break;
+      }
+      entry.res = ret < 0 ? -errno : ret;
+    }
+  }
+  bool ret = true;
+  for (auto& entry : ops_) ret &= Finish(entry);
+  return ret;
+}
+
+bool FsBatch::Succeeded(size_t index) const {
+  return ops_[index].res >= 0;
+}
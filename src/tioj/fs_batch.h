@@ -0,0 +1,49 @@
+#ifndef TIOJ_FS_BATCH_H_
+#define TIOJ_FS_BATCH_H_
+
+#include <vector>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+// A list of filesystem operations (of one box setup or teardown) run in order as one io_uring
+//  submission, or one by one if io_uring is not available
+// A failed operation is logged and does not stop the following ones; the permissions of created
+//  files are fixed up after the batch since there is no chmod in io_uring (and mode is subject to umask)
+class FsBatch {
+  enum class Op { MKDIR, CREATE, LINK, SYMLINK, RENAME, UNLINK, RMDIR };
+  struct Entry {
+    Op op;
+    fs::path path, path2;
+    fs::perms perms;
+    int res; // return value of the syscall, or -errno
+  };
+  std::vector<Entry> ops_;
+  bool use_io_uring_;
+
+  size_t Push(Op, const fs::path&, const fs::path& = {}, fs::perms = fs::perms::unknown);
+  bool RunIoUring();
+  bool Finish(Entry&);
+ public:
+  explicit FsBatch(bool use_io_uring) : use_io_uring_(use_io_uring) {}
+
+  // the following return the index of the operation, for Succeeded after Run
+  // an existing directory is not an error
+  size_t Mkdir(const fs::path&, fs::perms = fs::perms::unknown);
+  // an empty file, truncated if exists
+  size_t Create(const fs::path&, fs::perms);
+  // hard link, or copy with the same permissions if not on the same filesystem
+  size_t Link(const fs::path& from, const fs::path& to);
+  size_t Symlink(const fs::path& target, const fs::path& link);
+  size_t Rename(const fs::path& from, const fs::path& to, fs::perms = fs::perms::unknown);
+  // a nonexistent file is not an error
+  size_t Unlink(const fs::path&);
+  size_t Rmdir(const fs::path&);
+
+  // returns whether all operations succeeded; should be called only once
+  bool Run();
+  bool Succeeded(size_t index) const;
+  size_t Size() const { return ops_.size(); }
+};
+
+#endif  // TIOJ_FS_BATCH_H_
@@ -100,6 +100,13 @@ fs::path SubmissionRunPath(long id) {
   return kBoxRoot / PadInt(id, 6);
 }
 
+fs::path SubmissionArtifactPath(long id) {
+  return SubmissionRunPath(id) / "artifact";
+}
+fs::path SubmissionArtifactProgram(long id, Compiler lang) {
+  return SubmissionArtifactPath(id) / ("prog" + ProgramExtension(lang));
+}
+
 fs::path CompileBoxPath(long id, CompileSubtask subtask) {
   return SubmissionRunPath(id) / ("compile" + std::to_string((int)subtask));
 }
@@ -175,7 +182,7 @@ fs::path ExecuteBoxError(long id, int td, int stage, bool inside_box) {
   return Workdir(BoxRoot(ExecuteBoxPath(id, td, stage), inside_box)) / "error";
 }
 fs::path ExecuteBoxFinalOutput(long id, int td, int stage)  {
-  return ExecuteBoxPath(id, td, stage) / "output";
+  return SubmissionRunPath(id) / ("output" + PadInt(td, 3) + "_" + PadInt(stage, 2));
 }
 
 fs::path ScoringBoxPath(long id, int td, int stage) {
@@ -222,9 +229,39 @@ fs::path SummaryBoxOutput(long id, bool inside_box) {
   return Workdir(BoxRoot(SummaryBoxPath(id), inside_box)) / "output";
 }
 
-std::mutex& TdFileLock::operator[](int id) {
-  std::lock_guard lck(global_lock_);
-  return mutex_map_[id];
+void TdFileLock::Lock_(int id, bool exclusive) {
+  std::unique_lock lck(mtx_);
+  // entries are not erased while in use, and references to them stay valid on rehashing
+  Entry& entry = entries_[id];
+  entry.users++;
+  if (exclusive) {
+    entry.waiting_writers++;
+    entry.cv.wait(lck, [&]{ return !entry.writer && !entry.readers; });
+    entry.waiting_writers--;
+    entry.writer = true;
+  } else {
+    entry.cv.wait(lck, [&]{ return !entry.writer && !entry.waiting_writers; });
+    entry.readers++;
+  }
+}
+void TdFileLock::Unlock_(int id, bool exclusive) {
+  std::lock_guard lck(mtx_);
+  auto it = entries_.find(id);
+  Entry& entry = it->second;
+  if (exclusive) {
+    entry.writer = false;
+  } else {
+    entry.readers--;
+  }
+  if (!--entry.users) {
+    entries_.erase(it);
+  } else {
+    entry.cv.notify_all();
+  }
+}
+size_t TdFileLock::Size() {
+  std::lock_guard lck(mtx_);
+  return entries_.size();
 }
 TdFileLock td_file_lock;
 
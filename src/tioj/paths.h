@@ -13,6 +13,9 @@ fs::path Workdir(fs::path&&);
 // if inside_box = true, id (and subtask of Execute/Scoring) is not used
 // those calls will have id (and subtask) marked as -1
 fs::path SubmissionRunPath(long id);
+// compiled user program shared by all execute boxes; not visible in boxes
+fs::path SubmissionArtifactPath(long id);
+fs::path SubmissionArtifactProgram(long id, Compiler lang);
 fs::path CompileBoxPath(long id, CompileSubtask subtask);
 fs::path CompileBoxInput(long id, CompileSubtask subtask, Compiler lang, bool inside_box = false);
 fs::path CompileBoxInterlib(long id, int problem_id, bool inside_box = false);
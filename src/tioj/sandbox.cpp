@@ -1,6 +1,10 @@
 #include "sandbox.h"
 
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
 #include <unistd.h>
+#include <sys/socket.h>
 #include <cstring>
 #include <algorithm>
 #include <filesystem>
@@ -32,6 +36,7 @@ SandboxOptions::SandboxOptions(const std::vector<uint8_t>& vec) {
   fd_input = ReadInt();
   fd_output = ReadInt();
   fd_error = ReadInt();
+  relay_fds = ReadInt();
   cpu_set.resize(ReadInt());
   for (auto& i : cpu_set) i = ReadInt();
   uid = ReadInt();
@@ -78,6 +83,7 @@ std::vector<uint8_t> SandboxOptions::Serialize() const {
   PushInt(fd_input);
   PushInt(fd_output);
   PushInt(fd_error);
+  PushInt(relay_fds);
   PushInt(cpu_set.size());
   for (auto& i : cpu_set) PushInt(i);
   PushInt(uid);
@@ -156,3 +162,147 @@ CJailCtxClass SandboxOptions::ToCJailCtx() const {
   ctx.mount_cfg = ret.mnt_list_;
   return ret;
 }
+
+namespace {
+
+bool ReadAll(int fd, void* buf, size_t len) {
+  for (size_t cur = 0; cur < len;) {
+    ssize_t ret = read(fd, (char*)buf + cur, len - cur);
+    if (ret <= 0) {
+      if (ret < 0 && errno == EINTR) continue;
+      if (ret == 0) errno = EPIPE;
+      return false;
+    }
+    cur += ret;
+  }
+  return true;
+}
+
+bool WriteAll(int fd, const void* buf, size_t len) {
+  for (size_t cur = 0; cur < len;) {
+    ssize_t ret = write(fd, (const char*)buf + cur, len - cur);
+    if (ret < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    cur += ret;
+  }
+  return true;
+}
+
+constexpr int kMaxPassedFds = 3;
+
+} // namespace
+
+bool SendSandboxRequest(int sock, const SandboxOptions& opt) {
+  auto vec = opt.Serialize();
+  long size = vec.size();
+  int fds[kMaxPassedFds], nfds = 0;
+  for (int fd : {opt.fd_input, opt.fd_output, opt.fd_error}) {
+    if (fd != -1) fds[nfds++] = fd;
+  }
+  struct iovec iov = {&size, sizeof(size)};
+  alignas(struct cmsghdr) char cbuf[CMSG_SPACE(sizeof(fds))] = {};
+  struct msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  if (nfds) {
+    msg.msg_control = cbuf;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * nfds);
+  }
+  ssize_t ret;
+  while ((ret = sendmsg(sock, &msg, MSG_NOSIGNAL)) < 0 && errno == EINTR);
+  if (ret < 0) return false;
+  if (ret < (ssize_t)sizeof(size) && !WriteAll(sock, (char*)&size + ret, sizeof(size) - ret)) return false;
+  return WriteAll(sock, vec.data(), vec.size());
+}
+
+bool RecvSandboxRequest(int sock, SandboxOptions& opt) {
+  long size = 0;
+  struct iovec iov = {&size, sizeof(size)};
+  alignas(struct cmsghdr) char cbuf[CMSG_SPACE(sizeof(int) * kMaxPassedFds)] = {};
+  struct msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = cbuf;
+  msg.msg_controllen = sizeof(cbuf);
+  ssize_t ret;
+  while ((ret = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR);
+  if (ret <= 0) {
+    if (ret == 0) errno = EPIPE;
+    return false;
+  }
+  std::vector<int> fds;
+  for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+    size_t num = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    size_t cur = fds.size();
+    fds.resize(cur + num);
+    memcpy(fds.data() + cur, CMSG_DATA(cmsg), sizeof(int) * num);
+  }
+  auto CloseFds = [&]() { for (int fd : fds) close(fd); };
+  std::vector<uint8_t> buf;
+  if (ret < (ssize_t)sizeof(size) && !ReadAll(sock, (char*)&size + ret, sizeof(size) - ret)) goto err;
+  if (size < 0 || size > (1l << 30)) goto err_proto;
+  buf.resize(size);
+  if (!ReadAll(sock, buf.data(), size)) goto err;
+  opt = SandboxOptions(buf);
+  {
+    size_t cur = 0;
+    for (int* fd : {&opt.fd_input, &opt.fd_output, &opt.fd_error}) {
+      if (*fd == -1) continue;
+      if (cur == fds.size()) goto err_proto;
+      *fd = fds[cur++];
+    }
+    if (cur != fds.size()) goto err_proto;
+  }
+  return true;
+err_proto:
+  errno = EPROTO;
+err:
+  {
+    int saved_errno = errno;
+    CloseFds();
+    errno = saved_errno;
+  }
+  return false;
+}
+
+void SpliceRelay(int in_fd, int in_pipe, int out_pipe, int out_fd, size_t max_output) {
+  sigset_t mask;
+  sigfillset(&mask);
+  pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+  constexpr size_t kChunk = 1 << 20;
+  // poll ignores negative fds, so a finished direction is simply closed and set to -1
+  struct pollfd fds[2] = {{in_pipe, POLLOUT, 0}, {out_pipe, POLLIN, 0}};
+  auto Finish = [&](struct pollfd& pfd) {
+    close(pfd.fd);
+    pfd.fd = -1;
+  };
+  while (fds[0].fd != -1 || fds[1].fd != -1) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+    if (fds[0].fd != -1 && fds[0].revents) {
+      // EOF of the input, or the program closed its stdin
+      ssize_t ret = splice(in_fd, nullptr, in_pipe, nullptr, kChunk, SPLICE_F_NONBLOCK);
+      if (ret == 0 || (ret < 0 && errno != EAGAIN && errno != EINTR)) Finish(fds[0]);
+    }
+    if (fds[1].fd != -1 && fds[1].revents) {
+      // the program gets SIGPIPE once the output limit is reached, as with the file size limit
+      ssize_t ret = splice(out_pipe, nullptr, out_fd, nullptr, std::min(max_output, kChunk),
+                           SPLICE_F_NONBLOCK);
+      if (ret > 0) max_output -= ret;
+      if (ret == 0 || !max_output || (ret < 0 && errno != EAGAIN && errno != EINTR)) Finish(fds[1]);
+    }
+  }
+  for (auto& pfd : fds) {
+    if (pfd.fd != -1) close(pfd.fd);
+  }
+}
@@ -38,6 +38,8 @@ class SandboxOptions {
   // inside box (relative to boxdir but start with /)
   std::string workdir, input, output, error;
   int fd_input, fd_output, fd_error; // -1 for not dup; overrides input/output
+  // relay fd_input/fd_output through pipes; fd_output is truncated to fsize
+  bool relay_fds;
   std::vector<int> cpu_set;
   int uid, gid;
   long wall_time, cpu_time; // us
@@ -50,6 +52,7 @@ class SandboxOptions {
   SandboxOptions() :
       preserve_env(false),
       fd_input(-1), fd_output(-1), fd_error(-1),
+      relay_fds(false),
       uid(65534), gid(65534),
       wall_time(0), cpu_time(0),
       rss(0), vss(0),
@@ -65,4 +68,16 @@ class SandboxOptions {
   CJailCtxClass ToCJailCtx() const;
 };
 
+// Request protocol of sandbox-exec workers over a unix stream socket:
+//  a long size with the fds of fd_input/fd_output/fd_error (the ones that are not -1, in this order)
+//  attached by SCM_RIGHTS, then the serialized options; the response is a struct cjail_result
+bool SendSandboxRequest(int sock, const SandboxOptions&);
+// received fds are stored into fd_input/fd_output/fd_error; the caller should close them
+bool RecvSandboxRequest(int sock, SandboxOptions&);
+
+// Relay in_fd to the pipe in_pipe and the pipe out_pipe to out_fd (at most max_output bytes) with
+//  splice until both directions finish, then close in_pipe and out_pipe; meant to run on its own
+//  thread, which blocks all signals so that writing to a closed pipe fails with EPIPE
+void SpliceRelay(int in_fd, int in_pipe, int out_pipe, int out_fd, size_t max_output);
+
 #endif  // TIOJ_SANDBOX_H_
@@ -1,52 +1,166 @@
 #include "sandbox_exec.h"
 
+#include <poll.h>
+#include <spawn.h>
+#include <signal.h>
 #include <unistd.h>
+#include <sys/socket.h>
 #include <sys/wait.h>
+#include <vector>
 
 #include <spdlog/fmt/bundled/ranges.h>
 #include <spdlog/spdlog.h>
 #include <tioj/paths.h>
 
-struct cjail_result SandboxExec(const SandboxOptions& opt) {
-  struct cjail_result ret = {};
-  int inpipe[2], outpipe[2];
+namespace {
+
+struct SandboxWorker {
+  pid_t pid;
+  int sock; // our end of the socketpair; -1 if the worker is dead
+  bool busy;
+  int requests; // sent so far; the worker numbers them the same way (see sandbox_main.cpp)
+};
+std::vector<SandboxWorker> workers;
+
+bool SpawnWorker(SandboxWorker& worker) {
+  int sv[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) return false;
+  auto cmd = internal::kDataDir / "sandbox-exec";
+  char* const argv[] = {const_cast<char*>(cmd.c_str()), const_cast<char*>("--server"), nullptr};
+  // posix_spawn uses vfork semantics, so this does not copy the judge's address space
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_adddup2(&actions, sv[1], 0);
+#if __GLIBC_PREREQ(2, 34)
+  posix_spawn_file_actions_addclosefrom_np(&actions, 3);
+#endif
   pid_t pid;
-  if (pipe(inpipe) < 0 || pipe(outpipe) < 0) goto err;
-  pid = fork();
-  if (pid < 0) goto err;
-  if (pid == 0) {
-    dup2(inpipe[1], 1);
-    dup2(outpipe[0], 0);
-    close(inpipe[0]);
-    close(inpipe[1]);
-    close(outpipe[0]);
-    close(outpipe[1]);
-    auto cmd = internal::kDataDir / "sandbox-exec";
-    if (execl(cmd.c_str(), cmd.c_str(), nullptr) < 0) _exit(1);
-  }
-  {
-    spdlog::debug("cjail_exec pid={} childpid={} boxdir={} command={}",
-        getpid(), pid, opt.boxdir, fmt::format("{}", opt.command));
-    close(inpipe[1]);
-    close(outpipe[0]);
-    auto vec = opt.Serialize();
-    long size = vec.size();
-    if (write(outpipe[1], &size, sizeof(size)) < 0 ||
-        write(outpipe[1], vec.data(), vec.size()) < 0 ||
-        read(inpipe[0], &ret, sizeof(ret)) < 0) {
-      kill(SIGKILL, pid);
-      waitpid(pid, nullptr, 0);
-      goto err;
+  int ret = posix_spawn(&pid, cmd.c_str(), &actions, nullptr, argv, environ);
+  posix_spawn_file_actions_destroy(&actions);
+  // the worker gets EOF as soon as we close our end
+  close(sv[1]);
+  if (ret != 0) {
+    close(sv[0]);
+    errno = ret;
+    return false;
+  }
+  worker = {pid, sv[0], false, 0};
+  spdlog::debug("Spawned sandbox-exec worker pid={}", pid);
+  return true;
+}
+
+void KillWorker(SandboxWorker& worker) {
+  close(worker.sock);
+  kill(worker.pid, SIGKILL);
+  waitpid(worker.pid, nullptr, 0);
+  worker.sock = -1;
+}
+
+// an idle worker has nothing to read and is not hung up; otherwise it died or
+//  a request failed halfway
+bool WorkerIdle(const SandboxWorker& worker) {
+  struct pollfd pfd = {worker.sock, POLLIN, 0};
+  return poll(&pfd, 1, 0) == 0;
+}
+
+int AcquireWorker() {
+  for (size_t i = 0; i < workers.size(); i++) {
+    if (workers[i].busy || workers[i].sock == -1) continue;
+    if (!WorkerIdle(workers[i])) {
+      spdlog::info("Discarding sandbox-exec worker pid={}", workers[i].pid);
+      KillWorker(workers[i]);
+      continue;
+    }
+    workers[i].busy = true;
+    return i;
+  }
+  SandboxWorker worker;
+  if (!SpawnWorker(worker)) {
+    int err = errno;
+    spdlog::warn("Failed to spawn sandbox-exec worker: {}", strerror(err));
+    errno = err;
+    return -1;
+  }
+  worker.busy = true;
+  for (size_t i = 0; i < workers.size(); i++) {
+    if (workers[i].sock == -1) {
+      workers[i] = worker;
+      return i;
+    }
+  }
+  workers.push_back(worker);
+  return workers.size() - 1;
+}
+
+} // namespace
+
+int SandboxExecAsync(const SandboxOptions& opt) {
+  int id = AcquireWorker();
+  if (id < 0) return -1;
+  SandboxWorker& worker = workers[id];
+  spdlog::debug("cjail_exec worker={} pid={} boxdir={} command={}",
+      id, worker.pid, opt.boxdir, fmt::format("{}", opt.command));
+  // the worker is idle, so the request fits in the socket buffer without blocking for long
+  if (!SendSandboxRequest(worker.sock, opt)) {
+    int err = errno;
+    spdlog::warn("Failed to send request to sandbox-exec worker pid={}: {}", worker.pid, strerror(err));
+    KillWorker(worker);
+    worker.busy = false;
+    errno = err;
+    return -1;
+  }
+  worker.requests++;
+  return id;
+}
+
+int SandboxWorkerFd(int id) {
+  return workers[id].sock;
+}
+
+struct cjail_result SandboxWorkerResult(int id) {
+  SandboxWorker& worker = workers[id];
+  struct cjail_result ret = {};
+  for (size_t cur = 0; cur < sizeof(ret);) {
+    ssize_t sz = read(worker.sock, (char*)&ret + cur, sizeof(ret) - cur);
+    if (sz < 0 && errno == EINTR) continue;
+    if (sz <= 0) {
+      if (sz == 0) errno = EPIPE;
+      spdlog::warn("sandbox-exec worker pid={} failed: {}", worker.pid, strerror(errno));
+      ret = {};
+      ret.oomkill = errno;
+      ret.timekill = -1;
+      break;
     }
+    cur += sz;
   }
-  waitpid(pid, nullptr, 0);
+  worker.busy = false;
   if (ret.timekill == -1) {
     spdlog::warn("cjail_exec error: errno={} {}", ret.oomkill, strerror(ret.oomkill));
   }
+  if (!WorkerIdle(worker)) {
+    spdlog::info("Discarding sandbox-exec worker pid={}", worker.pid);
+    KillWorker(worker);
+  }
   return ret;
-err:
-  spdlog::warn("SandboxExec error: errno={} {}", errno, strerror(errno));
-  ret.oomkill = errno;
-  ret.timekill = -1;
-  return ret;
+}
+
+void SandboxWorkerKill(int id) {
+  SandboxWorker& worker = workers[id];
+  if (worker.sock == -1) return;
+  // the worker kills its children on SIGTERM and keeps serving (see sandbox_main.cpp); the request
+  //  number makes it skip the sandbox if it has not started yet
+  union sigval value;
+  value.sival_int = worker.requests;
+  sigqueue(worker.pid, SIGTERM, value);
+}
+
+struct cjail_result SandboxExec(const SandboxOptions& opt) {
+  int id = SandboxExecAsync(opt);
+  if (id < 0) {
+    struct cjail_result ret = {};
+    ret.oomkill = errno;
+    ret.timekill = -1;
+    return ret;
+  }
+  return SandboxWorkerResult(id);
 }
@@ -18,9 +18,25 @@
 //     - don't mount workdir; make nothing inside jail writable by uid,
 //       pre-open input/output file inside a directory not openable by uid
 //       and set input_fd/output_fd to deliver output (this prevents user from reopening it)
+//       with relay_fds set (so that the user cannot seek or read the output file)
 //       and set error to /dev/null
 //     - if pin is needed, mount a tmpfs with a small size (fits only pin output) onto workdir,
 //       set workdir to be non-writable by uid and pre-create a file writable by uid for pin output
+
+// Sandboxes run in a pool of long-lived sandbox-exec worker processes (sandbox-exec --server),
+//  each serving one request at a time; the judge process itself never forks.
+
+// Send the request to an idle worker (spawning one if needed) and return the worker id, -1 if failed.
+// The fds in the options are passed to the worker, so the caller can close them after return.
+int SandboxExecAsync(const SandboxOptions&);
+// becomes readable when the result is ready (or the worker died)
+int SandboxWorkerFd(int id);
+// read the result and release the worker; a failed worker is discarded
+struct cjail_result SandboxWorkerResult(int id);
+// SIGKILL the sandbox currently run by the worker; the result is still read by SandboxWorkerResult
+void SandboxWorkerKill(int id);
+
+// synchronous version of the above
 struct cjail_result SandboxExec(const SandboxOptions&);
 
 #endif  // TIOJ_SANDBOX_EXEC_H_
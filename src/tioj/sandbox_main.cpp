@@ -1,13 +1,32 @@
 #include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
 #include <unistd.h>
+#include <system_error>
+#include <thread>
 
 #include "sandbox.h"
 
 namespace {
 
+// requests are numbered from 1 in the order received; SandboxWorkerKill sends the number of the
+//  request to kill, so that a kill arriving before the sandbox is forked is not lost, and a late
+//  one (for a request already answered) does not hit the next request
+volatile sig_atomic_t current_request = 0;
+volatile sig_atomic_t killed_request = 0;
+
 struct cjail_result SandboxExec(const SandboxOptions& opt) {
   CJailCtxClass ctx = opt.ToCJailCtx();
   struct cjail_result ret = {};
+  if (killed_request == current_request) {
+    // killed before it started; report it as killed (the judge discards it anyway)
+    // a kill between this check and the fork can still be missed, but that window is tiny
+    ret.info.si_code = CLD_KILLED;
+    ret.info.si_status = SIGKILL;
+    return ret;
+  }
   if (cjail_exec(&ctx.GetCtx(), &ret) < 0) {
     ret.oomkill = errno;
     ret.timekill = -1;
@@ -15,13 +34,108 @@ struct cjail_result SandboxExec(const SandboxOptions& opt) {
   return ret;
 }
 
+struct cjail_result RunRequest(const SandboxOptions& req) {
+  if (!req.relay_fds) return SandboxExec(req);
+  SandboxOptions opt = req;
+  struct cjail_result ret = {};
+  int pipes[2][2] = {{-1, -1}, {-1, -1}};
+  std::thread relay;
+  if (pipe2(pipes[0], O_CLOEXEC) < 0 || pipe2(pipes[1], O_CLOEXEC) < 0) {
+    ret.oomkill = errno;
+    ret.timekill = -1;
+  } else {
+    try {
+      relay = std::thread(SpliceRelay, req.fd_input, pipes[0][1], pipes[1][0], req.fd_output,
+                          req.fsize * 1024);
+      // these ends are closed by the relay
+      pipes[0][1] = pipes[1][0] = -1;
+      opt.fd_input = pipes[0][0];
+      opt.fd_output = pipes[1][1];
+      ret = SandboxExec(opt);
+    } catch (const std::system_error& err) {
+      ret.oomkill = err.code().value();
+      ret.timekill = -1;
+    }
+  }
+  // closing the sandbox ends lets the relay see EOF (or EPIPE on the input side)
+  for (auto& i : pipes) {
+    for (int fd : i) {
+      if (fd != -1) close(fd);
+    }
+  }
+  // wait for the output to be completely written
+  if (relay.joinable()) relay.join();
+  return ret;
+}
+
+// SIGTERM handler of workers: mark the request as killed (see SandboxExec) and SIGKILL all children,
+//  that is, the sandbox (whose pid namespace dies with its init); cjail_exec then returns as usual
+// the relay thread blocks all signals, so this always runs on the thread that forked the sandbox
+void KillChildren(int, siginfo_t* info, void*) {
+  int saved_errno = errno;
+  // a plain kill (not from SandboxWorkerKill) means the current request
+  killed_request = info->si_code == SI_QUEUE ? info->si_value.sival_int : current_request;
+  if (killed_request != current_request) {
+    errno = saved_errno;
+    return;
+  }
+  int fd = open("/proc/thread-self/children", O_RDONLY | O_CLOEXEC);
+  if (fd >= 0) {
+    char buf[4096];
+    ssize_t len = read(fd, buf, sizeof(buf));
+    close(fd);
+    pid_t pid = 0;
+    for (ssize_t i = 0; i <= len; i++) {
+      if (i < len && buf[i] >= '0' && buf[i] <= '9') {
+        pid = pid * 10 + (buf[i] - '0');
+      } else {
+        if (pid > 0) kill(pid, SIGKILL);
+        pid = 0;
+      }
+    }
+  }
+  errno = saved_errno;
+}
+
+// Worker mode: fd 0 is a unix socket connected to the judge; serve requests (see SendSandboxRequest)
+//  one at a time until the judge closes it
+int Server() {
+  // keep the socket away from the sandboxed programs
+  int sock = fcntl(0, F_DUPFD_CLOEXEC, 3);
+  if (sock < 0) return 1;
+  int null_fd = open("/dev/null", O_RDONLY);
+  if (null_fd < 0 || dup2(null_fd, 0) < 0) return 1;
+  close(null_fd);
+  struct sigaction act = {};
+  act.sa_sigaction = KillChildren;
+  act.sa_flags = SA_RESTART | SA_SIGINFO;
+  sigemptyset(&act.sa_mask);
+  if (sigaction(SIGTERM, &act, nullptr) < 0) return 1;
+  if (access("/proc/thread-self/children", R_OK) < 0) {
+    fprintf(stderr, "sandbox-exec: /proc/thread-self/children is unavailable (CONFIG_PROC_CHILDREN); "
+                    "cancelled tasks will run until their limits\n");
+  }
+  SandboxOptions opt;
+  while (RecvSandboxRequest(sock, opt)) {
+    // the counterpart of SandboxWorker::requests
+    current_request = current_request + 1;
+    struct cjail_result res = RunRequest(opt);
+    for (int fd : {opt.fd_input, opt.fd_output, opt.fd_error}) {
+      if (fd != -1) close(fd);
+    }
+    if (write(sock, &res, sizeof(res)) != sizeof(res)) return 1;
+  }
+  return errno == EPIPE ? 0 : 1;
+}
+
 } // namespace
 
-int main() {
+int main(int argc, char** argv) {
+  if (argc > 1 && strcmp(argv[1], "--server") == 0) return Server();
   long sz = 0;
   if (read(0, &sz, sizeof(sz)) < 0) return 1;
   std::vector<uint8_t> buf(sz);
   if (read(0, buf.data(), sz) < 0) return 1;
-  struct cjail_result res = SandboxExec(SandboxOptions(buf));
+  struct cjail_result res = RunRequest(SandboxOptions(buf));
   if (write(1, &res, sizeof(res)) < 0) return 1;
 }
@@ -4,6 +4,9 @@
 #include <sys/stat.h>
 #include <mutex>
 #include <queue>
+#include <memory>
+#include <functional>
+#include <optional>
 #include <regex>
 #include <fstream>
 #include <unordered_set>
@@ -15,8 +18,18 @@
 #include "tasks.h"
 #include "utils.h"
 #include "paths.h"
+#include "task_graph.h"
+#include "thread_pool.h"
+#include "fs_batch.h"
+#include "tmpfs_pool.h"
+#include "trash.h"
 
 int kMaxParallel = 1;
+int kSetupThreads = 2;
+int kLookahead = 0;
+bool kBindTestdata = true;
+bool kIoUringSetup = false;
+long kMaxTrash = 4096 * 1024;
 cpu_set_t kPinnedCpus = {};
 long kMaxRSS = 2 * 1024 * 1024; // 2G
 long kMaxOutput = 1 * 1024 * 1024; // 1G
@@ -24,6 +37,9 @@ double kTimeMultiplier = 1.0;
 
 namespace {
 
+// larger programs are bind mounted into non-strict execute boxes instead of being copied
+constexpr size_t kExecuteProgramCopySize = 1024 * 1024;
+
 inline long ToUs(const struct timeval& v) {
   return ((long)v.tv_sec * 1'000'000 + v.tv_usec) * (long double)kTimeMultiplier;
 }
@@ -116,67 +132,58 @@ nlohmann::json SubmissionAndResult::SummaryMeta() const {
 
 namespace {
 
-// TaskEntry will form a dependency directed graph
+// Every submission owns a TaskGraph in task_arena, forming a dependency directed graph
 // Once a task is finished, it is removed from the graph
 // Any tasks with indeg = 0 will be pushed into task_queue
-struct TaskEntry {
-  static long task_count;
-  long id;
-  long submission_internal_id;
-  Task task;
-  long priority;
-  int task_order;
-  int indeg;
-  std::vector<long> edges;
-
-  TaskEntry() {}
-  TaskEntry(int sub_id, const Task& task, long priority, int order = 0) :
-      id(task_count++),
-      submission_internal_id(sub_id),
-      task(task), priority(priority),
-      task_order(order), indeg(0) {}
-  bool operator<(const TaskEntry& x) const {
-    return std::make_tuple(priority, -submission_internal_id, -task_order) <
-           std::make_tuple(x.priority, -x.submission_internal_id, -x.task_order);
-  }
-};
-long TaskEntry::task_count = 0;
+using TaskEntry = TaskGraph::Node;
 
 std::mutex task_mtx;
 std::condition_variable task_cv;
-std::unordered_map<long, TaskEntry> task_list;
-
-struct PriorityCompare {
-  bool operator()(long a, long b) {
-    return task_list[a] < task_list[b];
-  }
-};
-
-std::priority_queue<long, std::vector<long>, PriorityCompare> task_queue;
-std::unordered_map<int, long> handle_map;
+TaskArena task_arena;
+ReadyQueue task_queue;
+std::unordered_map<int, TaskRef> handle_map;
+std::unordered_map<long, std::unordered_set<int>> running_handles; // internal id -> handles in handle_map
+std::unordered_set<int> killed_handles;
 std::unordered_map<long, SubmissionAndResult> submission_list;
 
 // cancelling related
 std::unordered_map<long, long> submission_id_map; // submission id -> internal id
 std::unordered_set<long> cancelled_list;
 std::unordered_map<long, std::unordered_set<int>> cancelled_group; // internal id -> (group id)
+std::vector<long> newly_cancelled; // set by PushSubmission; their running tasks are killed by WorkLoop
+
+// Box setup & teardown (file copies, mounts and removals) run on box_pool without holding task_mtx,
+//  while Setup*/Finalize* only decide what to do and update results on the WorkLoop thread.
+// A setup job returns false if the sandbox should not be run (the task is finalized with an empty result);
+//  successors of a task are released after its teardown job finishes.
+using SetupJob = std::function<bool()>;
+using TeardownJob = std::function<void()>;
+std::unique_ptr<ThreadPool> box_pool;
+// non-strict execute boxes are pooled tmpfs directories linked from ExecuteBoxPath by symlinks
+std::unique_ptr<TmpfsPool> tmpfs_pool;
+// removed boxes are renamed into kBoxRoot/trash and deleted in the background
+std::unique_ptr<Trash> trash;
+// file copies (see Copy) up to the last finished submission; the amount since is logged with it
+FileTransferStats last_transfer{};
+struct FinishedJob {
+  TaskRef ref;
+  bool is_setup;
+  bool result; // return value of setup jobs; success of fetches
+  bool prestaged; // setup of a look-ahead task that does not hold a slot
+  bool is_fetch;
+};
+std::vector<FinishedJob> finished_jobs; // protected by task_mtx; consumed by WorkLoop
+int pending_teardowns = 0;
+// FETCH_TESTDATA tasks are started by PushSubmission as soon as the submission is queued, and
+//  never occupy a slot
+int pending_fetches = 0;
 
 /// Helpers for manipulating graphs
-inline void InsertTaskList(TaskEntry&& task) {
-  long tid = task.id;
-  int indeg = task.indeg;
-  task_list.insert({tid, std::move(task)});
-  if (!indeg) task_queue.push(tid);
-}
-inline void Link(TaskEntry& a, TaskEntry& b) {
-  a.edges.push_back(b.id);
-  b.indeg++;
-}
-inline void Remove(const TaskEntry& task) {
-  for (long nxt : task.edges) {
-    if (auto& nxt_task = task_list[nxt]; !--nxt_task.indeg) task_queue.push(nxt);
-  }
-  task_list.erase(task.id);
+inline void Remove(const TaskRef& ref) {
+  auto& slot = task_arena[ref.slot];
+  slot.graph.Remove(ref.node, [&](uint32_t nxt) { task_queue.push(task_arena.MakeReady(ref.slot, nxt)); });
+  // summary is always the last task of a submission
+  if (!slot.graph.Remaining()) task_arena.Release(ref.slot);
 }
 
 inline bool IsCancelled(long id, const std::vector<int>& groups) {
@@ -189,6 +196,26 @@ inline bool IsCancelled(long id, const std::vector<int>& groups) {
   return true;
 }
 
+// SIGKILL the running tasks of a submission whose results no longer matter
+// Killed tasks are discarded instead of finalized (see DiscardTask)
+void KillCancelledTasks(long id) {
+  auto it = running_handles.find(id);
+  if (it == running_handles.end()) return;
+  for (int handle : it->second) {
+    if (killed_handles.count(handle)) continue;
+    const TaskRef& ref = handle_map[handle];
+    auto& slot = task_arena[ref.slot];
+    const Task& task = slot.graph[ref.node].task;
+    // compile & summary results are needed unless the whole submission is cancelled
+    bool cancelled = task.type == TaskType::EXECUTE || task.type == TaskType::SCORING ?
+        IsCancelled(id, slot.sub->sub.testdata[task.subtask].td_groups) : cancelled_list.count(id);
+    if (!cancelled || !KillTask(handle)) continue;
+    spdlog::info("Killing cancelled task: id={} taskid={} tasktype={} subtask={} stage={}",
+                 id, ref.node, TaskTypeName(task.type), task.subtask, task.stage);
+    killed_handles.insert(handle);
+  }
+}
+
 inline long NormalizeScore(long double score) {
   constexpr long double kMax = 1'000'000;
   if (score > kMax) score = kMax;
@@ -206,59 +233,57 @@ inline Compiler GetLang(const Submission& sub, CompileSubtask subtask) {
 }
 
 /// Task env setup
-bool SetupCompile(const SubmissionAndResult& sub_and_result, const TaskEntry& task) {
+bool SetupCompile(const SubmissionAndResult& sub_and_result, const TaskEntry& task, SetupJob& job) {
   const Submission& sub = sub_and_result.sub;
   long id = sub.submission_internal_id;
   CompileSubtask subtask = (CompileSubtask)task.task.subtask;
   if (cancelled_list.count(id)) return false; // cancellation check
+  if (subtask == CompileSubtask::USERPROG && sub.reporter.ReportStartCompiling) {
+    sub.reporter.ReportStartCompiling(sub, sub_and_result.result);
+  }
 
-  CreateDirs(Workdir(CompileBoxPath(id, subtask)), fs::perms::all);
-  fs::path code_dest = CompileBoxInput(id, subtask, GetLang(sub, subtask));
-  switch (subtask) { // copy code
-    case CompileSubtask::USERPROG: {
-      Copy(SubmissionUserCode(id), code_dest, kPerm666);
-      break;
-    }
-    case CompileSubtask::SPECJUDGE: {
-      Copy(SubmissionJudgeCode(id), code_dest, kPerm666);
-      break;
-    }
-    case CompileSubtask::SUMMARY: {
-      Copy(SubmissionSummaryCode(id), code_dest, kPerm666);
-      break;
-    }
-  }
-  switch (subtask) { // copy other dependencies
-    case CompileSubtask::USERPROG: {
-      if (sub.reporter.ReportStartCompiling) sub.reporter.ReportStartCompiling(sub, sub_and_result.result);
-      switch (sub.interlib_type) {
-        case InterlibType::NONE: break;
-        case InterlibType::INCLUDE: {
-          Copy(SubmissionInterlibCode(id), CompileBoxInterlib(id, sub.problem_id), kPerm666);
-          Copy(SubmissionInterlibImplCode(id), CompileBoxInterlibImpl(id, sub.lang), kPerm666);
-          break;
+  job = [&sub, id, subtask]() {
+    CreateDirs(Workdir(CompileBoxPath(id, subtask)), fs::perms::all);
+    fs::path code_dest = CompileBoxInput(id, subtask, GetLang(sub, subtask));
+    switch (subtask) { // copy code
+      case CompileSubtask::USERPROG: {
+        Copy(SubmissionUserCode(id), code_dest, kPerm666);
+        break;
+      }
+      case CompileSubtask::SPECJUDGE: {
+        Copy(SubmissionJudgeCode(id), code_dest, kPerm666);
+        break;
+      }
+      case CompileSubtask::SUMMARY: {
+        Copy(SubmissionSummaryCode(id), code_dest, kPerm666);
+        break;
+      }
+    }
+    switch (subtask) { // copy other dependencies
+      case CompileSubtask::USERPROG: {
+        switch (sub.interlib_type) {
+          case InterlibType::NONE: break;
+          case InterlibType::INCLUDE: {
+            Copy(SubmissionInterlibCode(id), CompileBoxInterlib(id, sub.problem_id), kPerm666);
+            Copy(SubmissionInterlibImplCode(id), CompileBoxInterlibImpl(id, sub.lang), kPerm666);
+            break;
+          }
         }
+        break;
       }
-      break;
-    }
-    case CompileSubtask::SPECJUDGE: [[fallthrough]];
-    case CompileSubtask::SUMMARY: {
-      fs::path src = SpecjudgeHeadersPath();
-      fs::path box = Workdir(CompileBoxPath(id, subtask));
-      for (auto& dir_entry : fs::recursive_directory_iterator(src)) {
-        if (dir_entry.is_directory()) continue;
-        fs::path p = dir_entry.path();
-        const auto parent_dirs = box / fs::relative(p, src).parent_path();
-        CreateDirs(parent_dirs, fs::perms::all);
-        Copy(p, parent_dirs / p.filename(), kPerm666);
+      case CompileSubtask::SPECJUDGE: [[fallthrough]];
+      case CompileSubtask::SUMMARY: {
+        // judge headers are bind mounted by the sandbox (see CompileOptions)
+        break;
       }
-      break;
     }
-  }
+    return true;
+  };
   return true;
 }
 
-void FinalizeCompile(SubmissionAndResult& sub_and_result, const TaskEntry& task, const struct cjail_result& cjail_res) {
+TeardownJob FinalizeCompile(SubmissionAndResult& sub_and_result, const TaskEntry& task,
+                            const struct cjail_result& cjail_res) {
   const Submission& sub = sub_and_result.sub;
   SubmissionResult& sub_res = sub_and_result.result;
 
@@ -321,12 +346,25 @@ void FinalizeCompile(SubmissionAndResult& sub_and_result, const TaskEntry& task,
   } else {
     // success
     spdlog::info("Compilation successful: id={} subtask={}", id, CompileSubtaskName(subtask));
+    if (subtask == CompileSubtask::USERPROG) {
+      // promote the program once; execute boxes only link or bind mount it
+      return [&sub, id]() {
+        auto artifact = SubmissionArtifactProgram(id, sub.lang);
+        CreateDirs(SubmissionArtifactPath(id), fs::perms::owner_all); // 700
+        Move(CompileBoxOutput(id, CompileSubtask::USERPROG, sub.lang), artifact);
+        // it was owned by the uid of the compile sandbox, which is reused by other sandboxes
+        IGNORE_RETURN(chown(artifact.c_str(), 0, 0));
+        fs::permissions(artifact, ExecuteBoxProgramPerm(sub.lang, sub.sandbox_strict));
+      };
+    }
   }
+  return nullptr;
 }
 
-bool SetupExecute(SubmissionAndResult& sub_and_result, const TaskEntry& task) {
+// also checked before running a pre-staged execute box, since the submission can be cancelled meanwhile
+bool ExecuteNeeded(const SubmissionAndResult& sub_and_result, const TaskEntry& task) {
   const Submission& sub = sub_and_result.sub;
-  SubmissionResult& res = sub_and_result.result;
+  const SubmissionResult& res = sub_and_result.result;
 
   if (res.verdict != Verdict::NUL) return false; // CE check
   long id = sub.submission_internal_id;
@@ -336,44 +374,100 @@ bool SetupExecute(SubmissionAndResult& sub_and_result, const TaskEntry& task) {
 
   auto& td_result = res.td_results[subtask];
   if (stage > 0 && (td_result.skip_stage || td_result.verdict != Verdict::NUL)) return false;
-  auto workdir = Workdir(ExecuteBoxPath(id, subtask, stage));
-  CreateDirs(workdir);
-  if (!sub.sandbox_strict) { // for non-strict: mount a tmpfs to limit overall filesize
-    // TODO FEATURE(io-interactive): create FIFOs outside of workdir by hardlink
-    long tmpfs_size_kib =
-      (fs::file_size(CompileBoxOutput(id, CompileSubtask::USERPROG, sub.lang)) / 4096 + 1) * 4 +
-      (fs::file_size(sub.testdata[subtask].input_file) / 4096 + 1) * 4 +
-      std::min(sub.testdata[subtask].output * 2, kMaxOutput);
-    MountTmpfs(workdir, tmpfs_size_kib);
-  }
-  auto prog = ExecuteBoxProgram(id, subtask, stage, sub.lang);
-  Copy(CompileBoxOutput(id, CompileSubtask::USERPROG, sub.lang),
-       prog, ExecuteBoxProgramPerm(sub.lang, sub.sandbox_strict));
-  auto input_file = ExecuteBoxInput(id, subtask, stage, sub.sandbox_strict);
-  if (sub.sandbox_strict) {
-    CreateDirs(ExecuteBoxTdStrictPath(id, subtask, stage), fs::perms::owner_all); // 700
-    if (stage == 0) {
-      std::lock_guard lck(td_file_lock[sub.problem_id]);
-      Copy(sub.testdata[subtask].input_file, input_file,
-          fs::perms::owner_read | fs::perms::owner_write); // 600
-    } else {
-      Move(ExecuteBoxFinalOutput(id, subtask, stage - 1), input_file);
-      fs::permissions(input_file, fs::perms::owner_read | fs::perms::owner_write); // 600
+  return true;
+}
+
+// enough for all boxes being staged and run
+inline size_t TmpfsPoolSize() {
+  return kMaxParallel + kLookahead;
+}
+
+// undo the mounts of SetupExecute and remove the box
+void RemoveExecuteBox(const Submission& sub, long id, int subtask, int stage) {
+  fs::path box = ExecuteBoxPath(id, subtask, stage);
+  if (!sub.sandbox_strict) {
+    UmountIfMounted(ExecuteBoxProgram(id, subtask, stage, sub.lang));
+    if (fs::is_symlink(box)) {
+      fs::path tmpfs = fs::read_symlink(box);
+      RemoveAll(box);
+      tmpfs_pool->Release(tmpfs, TmpfsPoolSize());
+      return;
     }
-  } else {
-    fs::permissions(workdir, fs::perms::all);
-    if (stage == 0) {
-      std::lock_guard lck(td_file_lock[sub.problem_id]);
-      Copy(sub.testdata[subtask].input_file, input_file, kPerm666);
+  }
+  trash->Discard(box);
+}
+
+bool SetupExecute(SubmissionAndResult& sub_and_result, const TaskEntry& task, SetupJob& job) {
+  const Submission& sub = sub_and_result.sub;
+  if (!ExecuteNeeded(sub_and_result, task)) return false;
+  long id = sub.submission_internal_id;
+  int subtask = task.task.subtask;
+  int stage = task.task.stage;
+  // the testdata input is opened directly by ExecuteOptions instead of being copied into the box
+  bool bind_td = stage == 0 && kBindTestdata;
+  job = [&sub, id, subtask, stage, bind_td]() {
+    auto box = ExecuteBoxPath(id, subtask, stage);
+    auto workdir = Workdir(fs::path(box));
+    auto prog = ExecuteBoxProgram(id, subtask, stage, sub.lang);
+    auto input_file = ExecuteBoxInput(id, subtask, stage, sub.sandbox_strict);
+    CreateDirs(SubmissionRunPath(id));
+    // the directories and files of the box are created in one batch; mounts and copies follow
+    FsBatch batch(kIoUringSetup);
+    fs::path tmpfs;
+    size_t tmpfs_link = 0;
+    bool copy_prog = false;
+    if (!sub.sandbox_strict) { // for non-strict: use a tmpfs as the box to limit overall filesize
+      std::error_code ec;
+      size_t prog_size = fs::file_size(SubmissionArtifactProgram(id, sub.lang), ec);
+      copy_prog = !ec && prog_size <= kExecuteProgramCopySize;
+      // TODO FEATURE(io-interactive): create FIFOs outside of workdir by hardlink
+      long tmpfs_size_kib = std::min(sub.testdata[subtask].output, kMaxOutput) + 64; // error file & dirs
+      if (!bind_td && stage == 0) tmpfs_size_kib += (fs::file_size(sub.testdata[subtask].input_file) / 4096 + 1) * 4;
+      if (copy_prog) tmpfs_size_kib += (prog_size / 4096 + 1) * 4;
+      // falls back to a normal directory (created by the Mkdir below)
+      tmpfs = tmpfs_pool->Acquire(tmpfs_size_kib);
+      if (!tmpfs.empty()) tmpfs_link = batch.Symlink(tmpfs, box);
+    }
+    batch.Mkdir(box);
+    batch.Mkdir(workdir, sub.sandbox_strict ? fs::perms::unknown : fs::perms::all);
+    // the promoted program has ExecuteBoxProgramPerm and is owned by root; in non-strict mode the
+    //  permission is 777, so it is copied, or bind mounted read-only if large, to keep it shared safely
+    if (sub.sandbox_strict) {
+      batch.Link(SubmissionArtifactProgram(id, sub.lang), prog);
+      batch.Mkdir(ExecuteBoxTdStrictPath(id, subtask, stage), fs::perms::owner_all); // 700
+      if (stage > 0) {
+        batch.Rename(ExecuteBoxFinalOutput(id, subtask, stage - 1), input_file,
+                     fs::perms::owner_read | fs::perms::owner_write); // 600
+      }
+    }
+    batch.Run();
+    if (!tmpfs.empty() && !batch.Succeeded(tmpfs_link)) tmpfs_pool->Release(tmpfs, TmpfsPoolSize());
+    if (sub.sandbox_strict) {
+      if (!bind_td && stage == 0) {
+        auto lck = td_file_lock.Shared(sub.problem_id);
+        Copy(sub.testdata[subtask].input_file, input_file,
+            fs::perms::owner_read | fs::perms::owner_write); // 600
+      }
     } else {
-      Move(ExecuteBoxFinalOutput(id, subtask, stage - 1), input_file);
-      fs::permissions(input_file, kPerm666);
+      // the input and output are passed as opened files by ExecuteOptions, so that the only mount
+      //  left for most boxes is the remount of the pooled tmpfs
+      if (copy_prog) {
+        Copy(SubmissionArtifactProgram(id, sub.lang), prog, ExecuteBoxProgramPerm(sub.lang, false));
+      } else {
+        BindMount(SubmissionArtifactProgram(id, sub.lang), prog);
+      }
+      if (!bind_td && stage == 0) {
+        auto lck = td_file_lock.Shared(sub.problem_id);
+        Copy(sub.testdata[subtask].input_file, input_file, kPerm666);
+      }
     }
-  }
+    return true;
+  };
   return true;
 }
 
-void FinalizeExecute(SubmissionAndResult& sub_and_result, const TaskEntry& task, const struct cjail_result& cjail_res) {
+TeardownJob FinalizeExecute(SubmissionAndResult& sub_and_result, const TaskEntry& task,
+                            const struct cjail_result& cjail_res) {
   const Submission& sub = sub_and_result.sub;
   SubmissionResult& sub_res = sub_and_result.result;
 
@@ -383,17 +477,6 @@ void FinalizeExecute(SubmissionAndResult& sub_and_result, const TaskEntry& task,
   if (subtask >= (int)sub_res.td_results.size()) sub_res.td_results.resize(subtask + 1);
   auto& td_result = sub_res.td_results[subtask];
   td_result.execute_result = cjail_res;
-  Move(ExecuteBoxOutput(id, subtask, stage, sub.sandbox_strict),
-       ExecuteBoxFinalOutput(id, subtask, stage));
-  IGNORE_RETURN(chown(ExecuteBoxFinalOutput(id, subtask, stage).c_str(), 0, 0));
-  {
-    auto workdir = Workdir(ExecuteBoxPath(id, subtask, stage));
-    if (!sub.sandbox_strict) Umount(workdir);
-    RemoveAll(workdir);
-  }
-  if (stage > 0) {
-    RemoveAll(ExecuteBoxPath(id, subtask, stage - 1));
-  }
   auto& lim = sub.testdata[subtask];
   if (stage == 0) {
     td_result.vss = cjail_res.stats.hiwater_vm;
@@ -434,12 +517,28 @@ void FinalizeExecute(SubmissionAndResult& sub_and_result, const TaskEntry& task,
   spdlog::info("Execute finished: id={} subtask={} stage={} code={} status={} verdict={} time={} vss={} rss={}",
                id, subtask, stage, cjail_res.info.si_code, cjail_res.info.si_status, VerdictToAbr(td_result.verdict),
                td_result.time, td_result.vss, td_result.rss);
+  return [&sub, id, subtask, stage]() {
+    // non-strict output is already there (see SetupExecute)
+    if (sub.sandbox_strict) {
+      Move(ExecuteBoxOutput(id, subtask, stage, sub.sandbox_strict),
+           ExecuteBoxFinalOutput(id, subtask, stage));
+    }
+    IGNORE_RETURN(chown(ExecuteBoxFinalOutput(id, subtask, stage).c_str(), 0, 0));
+    RemoveExecuteBox(sub, id, subtask, stage);
+    if (stage > 0) trash->Discard(ExecuteBoxFinalOutput(id, subtask, stage - 1));
+  };
 }
 
-void FinalizeScoring(SubmissionAndResult& sub_and_result, const TaskEntry& task,
-                     const struct cjail_result& res, bool skipped = false);
+// Teardown of a staged execute box that is not going to run
+TeardownJob AbortExecute(const SubmissionAndResult& sub_and_result, const TaskEntry& task) {
+  const Submission& sub = sub_and_result.sub;
+  long id = sub.submission_internal_id;
+  int subtask = task.task.subtask;
+  int stage = task.task.stage;
+  return [&sub, id, subtask, stage]() { RemoveExecuteBox(sub, id, subtask, stage); };
+}
 
-bool SetupScoring(SubmissionAndResult& sub_and_result, const TaskEntry& task) {
+bool SetupScoring(SubmissionAndResult& sub_and_result, const TaskEntry& task, SetupJob& job) {
   const Submission& sub = sub_and_result.sub;
   SubmissionResult& res = sub_and_result.result;
 
@@ -455,44 +554,64 @@ bool SetupScoring(SubmissionAndResult& sub_and_result, const TaskEntry& task) {
   // if already TLE/MLE/etc, do not invoke old-style special judge
   if (td_result.verdict != Verdict::NUL &&
       sub.specjudge_type != SpecjudgeType::SPECJUDGE_NEW) {
-    FinalizeScoring(sub_and_result, task, {}, true);
-    return false;
+    job = []() { return false; };
+    return true;
   }
-  CreateDirs(Workdir(ScoringBoxPath(id, subtask, stage)), fs::perms::all);
-  // special judge program
-  fs::path specjudge_prog = sub.specjudge_type == SpecjudgeType::NORMAL ?
-      DefaultScoringPath() : CompileBoxOutput(id, CompileSubtask::SPECJUDGE, sub.specjudge_lang);
-  Copy(specjudge_prog, ScoringBoxProgram(id, subtask, stage, sub.specjudge_lang), fs::perms::all);
-  // user code
-  Copy(SubmissionUserCode(id), ScoringBoxUserCode(id, subtask, stage, sub.lang), kPerm666);
-  { // user output
+  std::string meta = sub_and_result.TestdataMeta(subtask, stage).dump(
+      -1, ' ', false, nlohmann::json::error_handler_t::ignore);
+  job = [&sub, id, subtask, stage, meta = std::move(meta)]() {
+    auto box = ScoringBoxPath(id, subtask, stage);
     auto user_output = ExecuteBoxFinalOutput(id, subtask, stage);
+    FsBatch batch(kIoUringSetup);
+    batch.Mkdir(box);
+    batch.Mkdir(Workdir(fs::path(box)), fs::perms::all);
     if (sub.specjudge_type == SpecjudgeType::SKIP) {
-      Move(user_output, ScoringBoxOutput(id, subtask, stage));
-      FinalizeScoring(sub_and_result, task, {});
+      batch.Rename(user_output, ScoringBoxOutput(id, subtask, stage));
+      batch.Run();
       return false;
     }
-    auto scoring_user_output = ScoringBoxUserOutput(id, subtask, stage);
-    if (fs::exists(user_output)) {
-      Move(user_output, scoring_user_output, kPerm666);
-    } else {
-      // touch file if not exist (if multistage skipped)
-      std::ofstream(scoring_user_output).close();
-      fs::permissions(scoring_user_output, kPerm666);
+    { // user output
+      auto scoring_user_output = ScoringBoxUserOutput(id, subtask, stage);
+      if (fs::exists(user_output)) {
+        batch.Rename(user_output, scoring_user_output, kPerm666);
+      } else {
+        // touch file if not exist (if multistage skipped)
+        batch.Create(scoring_user_output, kPerm666);
+      }
     }
-  }
-  { // input and answer
-    std::lock_guard lck(td_file_lock[sub.problem_id]);
-    Copy(sub.testdata[subtask].input_file, ScoringBoxTdInput(id, subtask, stage), kPerm666);
-    Copy(sub.testdata[subtask].answer_file, ScoringBoxTdOutput(id, subtask, stage), kPerm666);
-  }
-  { // write meta file
-    std::ofstream fout(ScoringBoxMetaFile(id, subtask, stage));
-    fout << sub_and_result.TestdataMeta(subtask, stage).dump(-1, ' ', false, nlohmann::json::error_handler_t::ignore);
-  }
+    batch.Run();
+    // special judge program
+    fs::path specjudge_prog = sub.specjudge_type == SpecjudgeType::NORMAL ?
+        DefaultScoringPath() : CompileBoxOutput(id, CompileSubtask::SPECJUDGE, sub.specjudge_lang);
+    Copy(specjudge_prog, ScoringBoxProgram(id, subtask, stage, sub.specjudge_lang), fs::perms::all);
+    // user code
+    Copy(SubmissionUserCode(id), ScoringBoxUserCode(id, subtask, stage, sub.lang), kPerm666);
+    { // input and answer
+      auto lck = td_file_lock.Shared(sub.problem_id);
+      if (kBindTestdata) {
+        BindMount(sub.testdata[subtask].input_file, ScoringBoxTdInput(id, subtask, stage));
+        BindMount(sub.testdata[subtask].answer_file, ScoringBoxTdOutput(id, subtask, stage));
+      } else {
+        Copy(sub.testdata[subtask].input_file, ScoringBoxTdInput(id, subtask, stage), kPerm666);
+        Copy(sub.testdata[subtask].answer_file, ScoringBoxTdOutput(id, subtask, stage), kPerm666);
+      }
+    }
+    { // write meta file
+      std::ofstream fout(ScoringBoxMetaFile(id, subtask, stage));
+      fout << meta;
+    }
+    return true;
+  };
   return true;
 }
 
+// the testdata may be bind mounted (or not staged at all if the scoring is skipped)
+void RemoveScoringBox(long id, int subtask, int stage) {
+  UmountIfMounted(ScoringBoxTdInput(id, subtask, stage));
+  UmountIfMounted(ScoringBoxTdOutput(id, subtask, stage));
+  trash->Discard(ScoringBoxPath(id, subtask, stage));
+}
+
 void ReadOldSpecjudgeResult(const fs::path& output_path, bool last_stage, SubmissionResult::TestdataResult& td_result) {
   int x;
   std::ifstream fin(output_path);
@@ -572,8 +691,8 @@ void ReadNewSpecjudgeResult(const fs::path& output_path, SubmissionResult::Testd
   if (!has_message) td_result.message_type = td_result.message = "";
 }
 
-void FinalizeScoring(SubmissionAndResult& sub_and_result, const TaskEntry& task,
-                     const struct cjail_result& cjail_res, bool skipped) {
+TeardownJob FinalizeScoring(SubmissionAndResult& sub_and_result, const TaskEntry& task,
+                            const struct cjail_result& cjail_res) {
   const Submission& sub = sub_and_result.sub;
   SubmissionResult& sub_res = sub_and_result.result;
 
@@ -587,9 +706,8 @@ void FinalizeScoring(SubmissionAndResult& sub_and_result, const TaskEntry& task,
   // default: WA or keep verdict (if TLE etc.) for last_stage,
   //          continue otherwise
   td_result.score = 0;
-  if (skipped) {
-    // skipped because of TLE/MLE/etc in old-style; do nothing
-  } else if (!fs::is_regular_file(output_path) || cjail_res.info.si_status != 0) {
+  if (!fs::is_regular_file(output_path) || cjail_res.info.si_status != 0) {
+    // also for old-style special judge skipped because of TLE/MLE/etc
     // skip remaining stages
     if (td_result.verdict == Verdict::NUL) td_result.verdict = Verdict::WA;
   } else if (sub.specjudge_type == SpecjudgeType::SPECJUDGE_OLD) {
@@ -609,29 +727,38 @@ void FinalizeScoring(SubmissionAndResult& sub_and_result, const TaskEntry& task,
   if (sub.skip_group && td_result.verdict != Verdict::NUL && td_result.verdict != Verdict::AC) {
     const auto& groups = sub.testdata[subtask].td_groups;
     cancelled_group[id].insert(groups.begin(), groups.end());
+    KillCancelledTasks(id);
   }
 
-  // move possibly modified user output back to original position
-  // so that it can be read by the next stage
-  if (!last_stage && !skipped && !td_result.skip_stage && sub.specjudge_type != SpecjudgeType::SKIP) {
-    Move(ScoringBoxUserOutput(id, subtask, stage), ExecuteBoxFinalOutput(id, subtask, stage));
-  }
-
-  // remove testdata-related files
-  if (last_stage) RemoveAll(ExecuteBoxPath(id, subtask, sub.stages - 1));
-  if (!skipped) RemoveAll(ScoringBoxPath(id, subtask, stage));
   if (!cancelled_list.count(id)) {
-    spdlog::info("Scoring {}: id={} subtask={} verdict={} score={} time={} vss={} rss={}",
-                 skipped ? "skipped" : "finished", id, subtask, VerdictToAbr(td_result.verdict),
+    spdlog::info("Scoring finished: id={} subtask={} verdict={} score={} time={} vss={} rss={}",
+                 id, subtask, VerdictToAbr(td_result.verdict),
                  td_result.score, td_result.time, td_result.vss, td_result.rss);
     if (sub.reporter.ReportScoringResult &&
         (sub.report_intermediate_stage || last_stage || td_result.skip_stage)) {
       sub.reporter.ReportScoringResult(sub, sub_res, subtask, stage);
     }
   }
+
+  // move possibly modified user output back to original position
+  // so that it can be read by the next stage
+  bool move_back = !last_stage && !td_result.skip_stage && sub.specjudge_type != SpecjudgeType::SKIP;
+  return [&sub, id, subtask, stage, last_stage, move_back]() {
+    if (move_back) Move(ScoringBoxUserOutput(id, subtask, stage), ExecuteBoxFinalOutput(id, subtask, stage));
+    // remove testdata-related files
+    if (last_stage) trash->Discard(ExecuteBoxFinalOutput(id, subtask, sub.stages - 1));
+    RemoveScoringBox(id, subtask, stage);
+  };
+}
+
+// Teardown of a scoring box whose task is discarded
+TeardownJob AbortScoring(const TaskEntry& task, long id) {
+  int subtask = task.task.subtask;
+  int stage = task.task.stage;
+  return [id, subtask, stage]() { RemoveScoringBox(id, subtask, stage); };
 }
 
-bool SetupSummary(SubmissionAndResult& sub_and_result, const TaskEntry& task) {
+bool SetupSummary(SubmissionAndResult& sub_and_result, const TaskEntry& task, SetupJob& job) {
   const Submission& sub = sub_and_result.sub;
   SubmissionResult& res = sub_and_result.result;
 
@@ -646,22 +773,26 @@ bool SetupSummary(SubmissionAndResult& sub_and_result, const TaskEntry& task) {
   if (sub.summary_type == SummaryType::NONE || res.verdict == Verdict::ER) return false;
 
   long id = sub.submission_internal_id;
-  CreateDirs(Workdir(SummaryBoxPath(id)), fs::perms::all);
-  Move(CompileBoxOutput(id, CompileSubtask::SUMMARY, sub.summary_lang),
-       SummaryBoxProgram(id, sub.summary_lang), fs::perms::all);
-  Copy(SubmissionUserCode(id), SummaryBoxUserCode(id, sub.lang), kPerm666);
-  if (fs::path ce_message_src = CompileBoxMessage(id, CompileSubtask::USERPROG);
-      fs::is_regular_file(ce_message_src)) {
-    Move(ce_message_src, SummaryBoxCEMessage(id), kPerm666);
-  } else {
-    // touch file
-    std::ofstream(SummaryBoxCEMessage(id)).close();
-    fs::permissions(SummaryBoxCEMessage(id), kPerm666);
-  }
-  { // write meta file
-    std::ofstream fout(SummaryBoxMetaFile(id));
-    fout << sub_and_result.SummaryMeta().dump(-1, ' ', false, nlohmann::json::error_handler_t::ignore);
-  }
+  std::string meta = sub_and_result.SummaryMeta().dump(-1, ' ', false, nlohmann::json::error_handler_t::ignore);
+  job = [&sub, id, meta = std::move(meta)]() {
+    CreateDirs(Workdir(SummaryBoxPath(id)), fs::perms::all);
+    Move(CompileBoxOutput(id, CompileSubtask::SUMMARY, sub.summary_lang),
+         SummaryBoxProgram(id, sub.summary_lang), fs::perms::all);
+    Copy(SubmissionUserCode(id), SummaryBoxUserCode(id, sub.lang), kPerm666);
+    if (fs::path ce_message_src = CompileBoxMessage(id, CompileSubtask::USERPROG);
+        fs::is_regular_file(ce_message_src)) {
+      Move(ce_message_src, SummaryBoxCEMessage(id), kPerm666);
+    } else {
+      // touch file
+      std::ofstream(SummaryBoxCEMessage(id)).close();
+      fs::permissions(SummaryBoxCEMessage(id), kPerm666);
+    }
+    { // write meta file
+      std::ofstream fout(SummaryBoxMetaFile(id));
+      fout << meta;
+    }
+    return true;
+  };
   return true;
 }
 
@@ -699,7 +830,8 @@ void ReadSummaryResult(const fs::path& output_path, SubmissionResult& res) {
 }
 
 /// Submission tasks env teardown
-void FinalizeSummary(SubmissionAndResult& sub_and_result, const TaskEntry& task, const struct cjail_result& cjail_res, bool skipped) {
+TeardownJob FinalizeSummary(SubmissionAndResult& sub_and_result, const TaskEntry& task,
+                            const struct cjail_result& cjail_res, bool skipped) {
   const Submission& sub = sub_and_result.sub;
   SubmissionResult& res = sub_and_result.result;
   long id = sub.submission_internal_id;
@@ -743,8 +875,17 @@ void FinalizeSummary(SubmissionAndResult& sub_and_result, const TaskEntry& task,
       }
     }
   }
-  if (sub.remove_submission) RemoveAll(SubmissionCodePath(id));
-  RemoveAll(SubmissionRunPath(id));
+  return [&sub, id]() {
+    if (sub.remove_submission) trash->Discard(SubmissionCodePath(id));
+    trash->Discard(SubmissionRunPath(id));
+  };
+}
+
+// Report and remove the submission after its summary is torn down
+void FinishSubmission(SubmissionAndResult& sub_and_result) {
+  const Submission& sub = sub_and_result.sub;
+  SubmissionResult& res = sub_and_result.result;
+  long id = sub.submission_internal_id;
   if (auto it = cancelled_list.find(id); it != cancelled_list.end()) {
     // cancelled, don't send anything to server
     cancelled_list.erase(it);
@@ -752,56 +893,172 @@ void FinalizeSummary(SubmissionAndResult& sub_and_result, const TaskEntry& task,
     if (sub.reporter.ReportOverallResult) sub.reporter.ReportOverallResult(sub, res);
   }
   cancelled_group.erase(id);
-  spdlog::info("Submission finished: id={} sub_id={} list_size={}", id, sub.submission_id, submission_list.size());
+  auto backlog = trash->GetBacklog();
+  // copies are shared by the submissions in flight, so this is the amount since the last one
+  auto transfer = GetFileTransferStats();
+  spdlog::info("Submission finished: id={} sub_id={} list_size={} trash_entries={} trash_bytes={} "
+               "copied_files={} copied_bytes={} copy_ms={}",
+               id, sub.submission_id, submission_list.size(), backlog.entries, backlog.bytes,
+               transfer.files - last_transfer.files, transfer.bytes - last_transfer.bytes,
+               (transfer.usec - last_transfer.usec) / 1000);
+  last_transfer = transfer;
   if (sub.reporter.ReportFinalized) sub.reporter.ReportFinalized(sub, res, submission_list.size());
   submission_id_map.erase(id);
   submission_list.erase(id);
 }
 
-// Call corresponding Finalize if not skipped & pop task from queue
-void FinalizeTask(long id, const struct cjail_result& res, bool skipped = false) {
-  auto& entry = task_list[id];
+// Release the successors of a task after its teardown
+void CompleteTask(const TaskRef& ref) {
+  auto& slot = task_arena[ref.slot];
+  if (slot.graph[ref.node].task.type == TaskType::SUMMARY) FinishSubmission(*slot.sub);
+  Remove(ref);
+}
+
+// Run the teardown job on box_pool; the task is completed afterwards
+void StartTeardown(const TaskRef& ref, TeardownJob&& job) {
+  if (!job) {
+    CompleteTask(ref);
+    return;
+  }
+  pending_teardowns++;
+  box_pool->Submit([ref, job = std::move(job)]() {
+    job();
+    {
+      std::lock_guard lck(task_mtx);
+      finished_jobs.push_back({ref, false, false, false, false});
+    }
+    task_cv.notify_one();
+    InterruptWait();
+  });
+}
+
+// Call corresponding Finalize if not skipped & start its teardown
+void FinalizeTask(const TaskRef& ref, const struct cjail_result& res, bool skipped = false) {
+  auto& slot = task_arena[ref.slot];
+  auto& entry = slot.graph[ref.node];
   spdlog::info("Finalizing task: id={} taskid={} tasktype={} subtask={} stage={} skipped={}",
-               entry.submission_internal_id, id, TaskTypeName(entry.task.type), entry.task.subtask, entry.task.stage, skipped);
+               slot.submission_internal_id, ref.node, TaskTypeName(entry.task.type),
+               entry.task.subtask, entry.task.stage, skipped);
+  TeardownJob job;
   if (!skipped || entry.task.type == TaskType::SUMMARY) {
-    auto& sub = submission_list.at(entry.submission_internal_id);
+    auto& sub = *slot.sub;
     switch (entry.task.type) {
-      case TaskType::COMPILE: FinalizeCompile(sub, entry, res); break;
-      case TaskType::EXECUTE: FinalizeExecute(sub, entry, res); break;
-      case TaskType::SCORING: FinalizeScoring(sub, entry, res); break;
-      case TaskType::SUMMARY: FinalizeSummary(sub, entry, res, skipped); break;
+      case TaskType::COMPILE: job = FinalizeCompile(sub, entry, res); break;
+      case TaskType::EXECUTE: job = FinalizeExecute(sub, entry, res); break;
+      case TaskType::SCORING: job = FinalizeScoring(sub, entry, res); break;
+      case TaskType::SUMMARY: job = FinalizeSummary(sub, entry, res, skipped); break;
+      case TaskType::FETCH_TESTDATA: break; // see FinishFetch
     }
   }
-  Remove(entry);
+  StartTeardown(ref, std::move(job));
 }
 
-bool DispatchTask(long id) {
-  auto& entry = task_list[id];
-  auto& sub = submission_list.at(entry.submission_internal_id);
+// Tear down a task whose result no longer matters without finalizing it: a pre-staged task that
+//  does not need to run (see ExecuteNeeded), or a cancelled task killed while running
+// Files other than mounted execute & scoring boxes are removed along with the submission
+void DiscardTask(const TaskRef& ref) {
+  auto& slot = task_arena[ref.slot];
+  auto& entry = slot.graph[ref.node];
+  spdlog::info("Discarding task: id={} taskid={} tasktype={} subtask={} stage={}",
+               slot.submission_internal_id, ref.node, TaskTypeName(entry.task.type),
+               entry.task.subtask, entry.task.stage);
+  if (entry.task.type == TaskType::EXECUTE) {
+    StartTeardown(ref, AbortExecute(*slot.sub, entry));
+  } else if (entry.task.type == TaskType::SCORING) {
+    StartTeardown(ref, AbortScoring(entry, slot.submission_internal_id));
+  } else {
+    FinalizeTask(ref, {}, true);
+  }
+}
+
+// return true if the task occupies a slot (that is, its box is being staged)
+// a prestaged task is staged ahead of time without a slot, and waits for one afterwards
+bool DispatchTask(const TaskRef& ref, bool prestaged = false) {
+  auto& slot = task_arena[ref.slot];
+  auto& entry = slot.graph[ref.node];
+  auto& sub = *slot.sub;
   spdlog::info("Dispatching task: id={} taskid={} tasktype={} subtask={} stage={}",
-               entry.submission_internal_id, id, TaskTypeName(entry.task.type), entry.task.subtask, entry.task.stage);
+               slot.submission_internal_id, ref.node, TaskTypeName(entry.task.type),
+               entry.task.subtask, entry.task.stage);
   bool res = false;
+  SetupJob job;
   switch (entry.task.type) {
-    case TaskType::COMPILE: res = SetupCompile(sub, entry); break;
-    case TaskType::EXECUTE: res = SetupExecute(sub, entry); break;
-    case TaskType::SCORING: res = SetupScoring(sub, entry); break;
-    case TaskType::SUMMARY: res = SetupSummary(sub, entry); break;
+    case TaskType::COMPILE: res = SetupCompile(sub, entry, job); break;
+    case TaskType::EXECUTE: res = SetupExecute(sub, entry, job); break;
+    case TaskType::SCORING: res = SetupScoring(sub, entry, job); break;
+    case TaskType::SUMMARY: res = SetupSummary(sub, entry, job); break;
+    case TaskType::FETCH_TESTDATA: break; // see StartFetch
   }
   if (!res) {
-    FinalizeTask(id, {}, true);
+    FinalizeTask(ref, {}, true);
+    return false;
+  }
+  box_pool->Submit([ref, prestaged, job = std::move(job)]() {
+    bool res = job();
+    {
+      std::lock_guard lck(task_mtx);
+      finished_jobs.push_back({ref, true, res, prestaged, false});
+    }
+    task_cv.notify_one();
+    InterruptWait();
+  });
+  return true;
+}
+
+// return true if the task is running (otherwise it is finalized and releases its slot)
+bool RunStagedTask(const TaskRef& ref, bool run) {
+  if (!run) {
+    FinalizeTask(ref, {});
     return false;
   }
-  int handle = RunTask(submission_list.at(entry.submission_internal_id), entry.task);
-  handle_map[handle] = id;
+  auto& slot = task_arena[ref.slot];
+  int handle = RunTask(*slot.sub, slot.graph[ref.node].task);
+  handle_map[handle] = ref;
+  running_handles[slot.submission_internal_id].insert(handle);
   return true;
 }
 
-std::pair<long, struct cjail_result> WaitTask() {
+// Called without task_mtx, since done() can be called within fetch_testdata
+void StartFetch(const TaskRef& ref, const Submission& sub, int subtask) {
+  sub.fetch_testdata(sub, subtask, [ref](bool ok) {
+    {
+      std::lock_guard lck(task_mtx);
+      finished_jobs.push_back({ref, false, ok, false, true});
+    }
+    task_cv.notify_one();
+    InterruptWait();
+  });
+}
+
+void FinishFetch(const TaskRef& ref, bool ok) {
+  auto& slot = task_arena[ref.slot];
+  int subtask = slot.graph[ref.node].task.subtask;
+  SubmissionResult& res = slot.sub->result;
+  spdlog::info("Testdata fetched: id={} subtask={} success={}", slot.submission_internal_id, subtask, ok);
+  // remaining executions are skipped (see ExecuteNeeded) unless it is already CE etc.
+  if (!ok && (int)res.verdict < (int)Verdict::CE) res.verdict = Verdict::JE;
+  CompleteTask(ref);
+}
+
+struct TaskResult {
+  TaskRef ref;
+  struct cjail_result res;
+  bool killed;
+};
+
+// return std::nullopt if interrupted by new work or finished box jobs
+std::optional<TaskResult> WaitTask() {
   std::pair<int, struct cjail_result> res = WaitAnyResult();
   auto it = handle_map.find(res.first);
-  long ret = it->second;
+  if (it == handle_map.end()) return std::nullopt;
+  TaskResult ret = {it->second, res.second, (bool)killed_handles.erase(res.first)};
   handle_map.erase(it);
-  return {ret, res.second};
+  long id = task_arena[ret.ref.slot].submission_internal_id;
+  if (auto h = running_handles.find(id); h != running_handles.end()) {
+    h->second.erase(res.first);
+    if (h->second.empty()) running_handles.erase(h);
+  }
+  return ret;
 }
 
 } // namespace
@@ -809,23 +1066,94 @@ std::pair<long, struct cjail_result> WaitTask() {
 void WorkLoop(bool loop) {
   umask(0022);
   std::unique_lock lck(task_mtx);
+  if (!box_pool) {
+    // mounts leaked by a previous run are reclaimed here
+    UmountAll(kBoxRoot);
+    box_pool = std::make_unique<ThreadPool>(kSetupThreads);
+    tmpfs_pool = std::make_unique<TmpfsPool>(kBoxRoot / "tmpfs");
+    trash = std::make_unique<Trash>(kBoxRoot / "trash", kMaxTrash * 1024);
+  }
+  box_pool->Submit([]{ tmpfs_pool->Fill(TmpfsPoolSize()); });
   do {
     // no task running here
     task_cv.wait(lck, []{ return !task_queue.empty(); });
+    // tasks being staged or running in sandboxes
     int task_running = 0;
-    while (task_running || !task_queue.empty()) {
-      if (task_running < kMaxParallel && task_queue.size()) {
-        long tid = task_queue.top();
+    // look-ahead tasks being staged without a slot, or staged and waiting for one (in staged)
+    int prestaging = 0;
+    std::vector<ReadyTask> staged;
+    while (task_running || prestaging || pending_teardowns || pending_fetches || !task_queue.empty()) {
+      // the best staged task; a staged task is run before queued ones of lower priority
+      auto best_staged = std::max_element(staged.begin(), staged.end());
+      if (!newly_cancelled.empty()) {
+        for (long id : newly_cancelled) KillCancelledTasks(id);
+        newly_cancelled.clear();
+      } else if (!finished_jobs.empty()) {
+        auto jobs = std::move(finished_jobs);
+        finished_jobs.clear();
+        for (auto& job : jobs) {
+          if (job.is_fetch) {
+            pending_fetches--;
+            FinishFetch(job.ref, job.result);
+          } else if (job.is_setup && job.prestaged) {
+            if (job.result) {
+              staged.push_back(task_arena.MakeReady(job.ref.slot, job.ref.node));
+            } else {
+              prestaging--;
+              RunStagedTask(job.ref, false);
+            }
+          } else if (job.is_setup) {
+            if (!RunStagedTask(job.ref, job.result)) task_running--;
+          } else {
+            pending_teardowns--;
+            CompleteTask(job.ref);
+          }
+        }
+      } else if (auto it = std::find_if(staged.begin(), staged.end(), [](const ReadyTask& x) {
+                   auto& slot = task_arena[x.ref.slot];
+                   return !ExecuteNeeded(*slot.sub, slot.graph[x.ref.node]);
+                 }); it != staged.end()) {
+        // cancelled (or skipped) while waiting for a slot
+        TaskRef ref = it->ref;
+        staged.erase(it);
+        prestaging--;
+        DiscardTask(ref);
+      } else if (task_running < kMaxParallel && staged.size() &&
+                 (task_queue.empty() || !(*best_staged < task_queue.top()))) {
+        TaskRef ref = best_staged->ref;
+        staged.erase(best_staged);
+        prestaging--;
+        task_running++;
+        RunStagedTask(ref, true);
+      } else if (task_running < kMaxParallel && task_queue.size()) {
+        TaskRef ref = task_queue.top().ref;
         task_queue.pop();
-        task_running += DispatchTask(tid);
+        task_running += DispatchTask(ref);
         // if this is a finalize task or a skipped stage (such as execute/scoring stage of a CE submission),
-        //  it will finish & finalize immediately without adding any running task
+        //  it will finalize immediately without occupying a slot
+      } else if (prestaging < kLookahead && task_queue.size() &&
+                 task_arena[task_queue.top().ref.slot].graph[task_queue.top().ref.node].task.type == TaskType::EXECUTE) {
+        // all slots are busy; stage the box of the next execute task so that it can start right away
+        TaskRef ref = task_queue.top().ref;
+        task_queue.pop();
+        prestaging += DispatchTask(ref, true);
+      } else if (handle_map.empty()) {
+        // nothing is running in sandboxes; wait for box jobs or new submissions
+        task_cv.wait(lck, [&]{
+          return !finished_jobs.empty() || (task_running < kMaxParallel && (task_queue.size() || staged.size()));
+        });
       } else {
         lck.unlock();
-        std::pair<long, struct cjail_result> tid = WaitTask();
+        auto tid = WaitTask();
         lck.lock();
-        FinalizeTask(tid.first, tid.second);
+        // interrupted by PushSubmission or box jobs; check them first
+        if (!tid) continue;
         task_running--;
+        if (tid->killed) {
+          DiscardTask(tid->ref);
+        } else {
+          FinalizeTask(tid->ref, tid->res);
+        }
       }
     }
   } while (loop);
@@ -854,8 +1182,11 @@ bool PushSubmission(Submission&& sub, size_t max_queue) {
   //                             |        |                       compile_summary ---+
   //                             |        v                                          |
   // compile ---+-> execute_0_0 ---> scoring_0_0---> execute_0_1 ---> scoring_0_1 ---+--->  summary
-  //            |                |                                                   |
+  //            |    ^           |                                                   |
   //            +-> execute_1_0 -+-> scoring_1_0---> execute_1_1 -+-> scoring_1_1 ---+
+  //            |    ^     ^
+  // fetch_0 ---|----+     |  (only if fetch_testdata is set)
+  // fetch_1 ---|----------+
   //
   std::unique_lock lck(task_mtx);
   if (max_queue > 0 && submission_list.size() >= max_queue) return false;
@@ -904,57 +1235,86 @@ bool PushSubmission(Submission&& sub, size_t max_queue) {
   } else {
     for (int i = 0; i < num_tds; i++) td_order[i] = i;
   }
-  std::vector<std::vector<TaskEntry>> executes, scorings;
-  TaskEntry summary(id, {TaskType::SUMMARY, 0, 0}, priority);
+  auto& sub_and_result = submission_list.emplace(id, std::move(sub)).first->second;
+  const Submission& nsub = sub_and_result.sub;
+  uint32_t slot_id = task_arena.Allocate(id, priority, &sub_and_result);
+  TaskGraph& graph = task_arena[slot_id].graph;
+  // compile tasks are added first so that they are dispatched first among tasks of the same order
+  uint32_t compile = graph.AddNode({TaskType::COMPILE, (int)CompileSubtask::USERPROG}, 0);
+  uint32_t compile_sj = -1, compile_summary = -1;
+  if (nsub.specjudge_type == SpecjudgeType::SPECJUDGE_OLD ||
+      nsub.specjudge_type == SpecjudgeType::SPECJUDGE_NEW) {
+    compile_sj = graph.AddNode({TaskType::COMPILE, (int)CompileSubtask::SPECJUDGE}, 0);
+  }
+  if (nsub.summary_type == SummaryType::CUSTOM) {
+    compile_summary = graph.AddNode({TaskType::COMPILE, (int)CompileSubtask::SUMMARY}, 0);
+  }
+  std::vector<uint32_t> last_scorings(num_tds);
   for (int i = 0; i < num_tds; i++) {
-    executes.emplace_back(); // index i
-    scorings.emplace_back();
-    if (sub.judge_between_stages) {
-      for (int j = 0; j < sub.stages; j++) {
-        executes[i].emplace_back(id, (Task){TaskType::EXECUTE, i, j}, priority, td_order[i]);
-        scorings[i].emplace_back(id, (Task){TaskType::SCORING, i, j}, priority, td_order[i]);
-        Link(executes[i][j], scorings[i][j]);
-        if (j > 0) Link(scorings[i][j - 1], executes[i][j]);
+    uint32_t prev = -1;
+    uint32_t fetch = -1;
+    if (nsub.fetch_testdata) fetch = graph.AddNode({TaskType::FETCH_TESTDATA, i, 0}, td_order[i]);
+    if (nsub.judge_between_stages) {
+      for (int j = 0; j < nsub.stages; j++) {
+        uint32_t execute = graph.AddNode({TaskType::EXECUTE, i, j}, td_order[i]);
+        uint32_t scoring = graph.AddNode({TaskType::SCORING, i, j}, td_order[i]);
+        graph.Link(execute, scoring);
+        if (j > 0) graph.Link(prev, execute);
+        if (j == 0) {
+          graph.Link(compile, execute);
+          if (fetch != (uint32_t)-1) graph.Link(fetch, execute);
+          if (compile_sj != (uint32_t)-1) graph.Link(compile_sj, scoring);
+        }
+        prev = scoring;
       }
     } else {
-      for (int j = 0; j < sub.stages; j++) {
-        executes[i].emplace_back(id, (Task){TaskType::EXECUTE, i, j}, priority, td_order[i]);
-        if (j > 0) Link(executes[i][j - 1], executes[i][j]);
+      for (int j = 0; j < nsub.stages; j++) {
+        uint32_t execute = graph.AddNode({TaskType::EXECUTE, i, j}, td_order[i]);
+        if (j > 0) graph.Link(prev, execute);
+        if (j == 0) {
+          graph.Link(compile, execute);
+          if (fetch != (uint32_t)-1) graph.Link(fetch, execute);
+        }
+        prev = execute;
       }
-      scorings[i].emplace_back(id, (Task){TaskType::SCORING, i, sub.stages - 1}, priority, td_order[i]);
-      Link(executes[i].back(), scorings[i].back());
+      uint32_t scoring = graph.AddNode({TaskType::SCORING, i, nsub.stages - 1}, td_order[i]);
+      graph.Link(prev, scoring);
+      if (compile_sj != (uint32_t)-1) graph.Link(compile_sj, scoring);
+      prev = scoring;
     }
-    Link(scorings[i].back(), summary);
+    last_scorings[i] = prev;
   }
-  {
-    TaskEntry compile(id, {TaskType::COMPILE, (int)CompileSubtask::USERPROG}, priority);
-    for (auto& i : executes) Link(compile, i[0]);
-    if (executes.empty()) Link(compile, summary);
-    InsertTaskList(std::move(compile));
-  }
-  if (sub.specjudge_type == SpecjudgeType::SPECJUDGE_OLD ||
-      sub.specjudge_type == SpecjudgeType::SPECJUDGE_NEW) {
-    TaskEntry compile(id, {TaskType::COMPILE, (int)CompileSubtask::SPECJUDGE}, priority);
-    for (auto& i : scorings) Link(compile, i[0]);
-    if (executes.empty()) Link(compile, summary);
-    InsertTaskList(std::move(compile));
-  }
-  if (sub.summary_type == SummaryType::CUSTOM) {
-    TaskEntry compile(id, {TaskType::COMPILE, (int)CompileSubtask::SUMMARY}, priority);
-    Link(compile, summary);
-    InsertTaskList(std::move(compile));
-  }
-  for (auto& i : executes) for (auto& j : i) InsertTaskList(std::move(j));
-  for (auto& i : scorings) for (auto& j : i) InsertTaskList(std::move(j));
-  InsertTaskList(std::move(summary));
-  submission_list.insert({id, std::move(sub)});
-  if (auto it = submission_id_map.insert({sub.submission_id, id}); !it.second) {
+  uint32_t summary = graph.AddNode({TaskType::SUMMARY, 0, 0}, 0);
+  for (uint32_t i : last_scorings) graph.Link(i, summary);
+  if (!num_tds) {
+    graph.Link(compile, summary);
+    if (compile_sj != (uint32_t)-1) graph.Link(compile_sj, summary);
+  }
+  if (compile_summary != (uint32_t)-1) graph.Link(compile_summary, summary);
+  graph.Freeze();
+  std::vector<std::pair<TaskRef, int>> fetches;
+  graph.ForEachRoot([&](uint32_t node) {
+    ReadyTask task = task_arena.MakeReady(slot_id, node);
+    if (graph[node].task.type == TaskType::FETCH_TESTDATA) {
+      fetches.push_back({task.ref, graph[node].task.subtask});
+    } else {
+      task_queue.push(task);
+    }
+  });
+  pending_fetches += fetches.size();
+  if (auto it = submission_id_map.insert({nsub.submission_id, id}); !it.second) {
     // if the same submission is already judging, mark it as cancelled
     cancelled_list.insert(it.first->second);
+    newly_cancelled.push_back(it.first->second);
     it.first->second = id;
   }
-  spdlog::info("Submission enqueued: id={} sub_id={} prob_id={} list_size={}", id, sub.submission_id, sub.problem_id, submission_list.size());
+  spdlog::info("Submission enqueued: id={} sub_id={} prob_id={} list_size={}",
+               id, nsub.submission_id, nsub.problem_id, submission_list.size());
   lck.unlock();
+  // the submission is not removed before its fetches finish, so nsub stays valid
+  for (auto& [ref, subtask] : fetches) StartFetch(ref, nsub, subtask);
   task_cv.notify_one();
+  // WorkLoop may be waiting for running tasks while there are free slots
+  InterruptWait();
   return true;
 }
@@ -0,0 +1,58 @@
+#include "task_graph.h"
+
+uint32_t TaskGraph::AddNode(const Task& task, int order) {
+  nodes_.push_back({task, order, 0, 0, 0});
+  remaining_++;
+  return nodes_.size() - 1;
+}
+
+void TaskGraph::Freeze() {
+  // counting sort by source node
+  for (auto& [a, b] : pending_edges_) {
+    nodes_[a].edge_end++;
+    nodes_[b].indeg++;
+  }
+  uint32_t offset = 0;
+  for (auto& node : nodes_) {
+    node.edge_begin = offset;
+    offset += node.edge_end;
+    node.edge_end = node.edge_begin;
+  }
+  edges_.resize(offset);
+  for (auto& [a, b] : pending_edges_) edges_[nodes_[a].edge_end++] = b;
+  pending_edges_.clear();
+}
+
+void TaskGraph::Clear() {
+  nodes_.clear();
+  edges_.clear();
+  pending_edges_.clear();
+  remaining_ = 0;
+}
+
+uint32_t TaskArena::Allocate(long submission_internal_id, long priority, SubmissionAndResult* sub) {
+  uint32_t ret;
+  if (free_slots_.empty()) {
+    ret = slots_.size();
+    slots_.emplace_back();
+    slots_.back().generation = 0;
+  } else {
+    ret = free_slots_.back();
+    free_slots_.pop_back();
+  }
+  Slot& slot = slots_[ret];
+  slot.in_use = true;
+  slot.submission_internal_id = submission_internal_id;
+  slot.priority = priority;
+  slot.sub = sub;
+  slot.graph.Clear();
+  return ret;
+}
+
+void TaskArena::Release(uint32_t slot) {
+  Slot& s = slots_[slot];
+  s.in_use = false;
+  s.generation++;
+  s.sub = nullptr;
+  free_slots_.push_back(slot);
+}
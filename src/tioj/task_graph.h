@@ -0,0 +1,120 @@
+#ifndef TIOJ_TASK_GRAPH_H_
+#define TIOJ_TASK_GRAPH_H_
+
+#include <deque>
+#include <queue>
+#include <vector>
+#include <cstdint>
+
+#include "tasks.h"
+
+struct SubmissionAndResult;
+
+// TaskGraph stores the dependency DAG of one submission in contiguous arrays
+// Nodes are addressed by their index; Link() only records the edge, and Freeze() packs
+//  all edges into a flat adjacency array (CSR) once the graph is completely built
+// Once a task is finished, Remove() decreases the indegree of its successors
+class TaskGraph {
+ public:
+  struct Node {
+    Task task;
+    int task_order;
+    int indeg;
+    uint32_t edge_begin, edge_end;
+  };
+
+ private:
+  std::vector<Node> nodes_;
+  std::vector<uint32_t> edges_;
+  std::vector<std::pair<uint32_t, uint32_t>> pending_edges_;
+  size_t remaining_ = 0;
+
+ public:
+  uint32_t AddNode(const Task& task, int order = 0);
+  void Link(uint32_t a, uint32_t b) { pending_edges_.emplace_back(a, b); }
+  void Freeze();
+  // keep the capacity so that a reused arena slot does not reallocate
+  void Clear();
+
+  const Node& operator[](uint32_t x) const { return nodes_[x]; }
+  size_t Size() const { return nodes_.size(); }
+  size_t Remaining() const { return remaining_; }
+
+  // call func(node) for every node with indeg = 0; only valid after Freeze()
+  template <class Func> void ForEachRoot(Func&& func) const {
+    for (uint32_t i = 0; i < nodes_.size(); i++) {
+      if (!nodes_[i].indeg) func(i);
+    }
+  }
+  // call func(node) for every successor whose indeg becomes 0
+  template <class Func> void Remove(uint32_t x, Func&& func) {
+    for (uint32_t i = nodes_[x].edge_begin; i < nodes_[x].edge_end; i++) {
+      if (!--nodes_[edges_[i]].indeg) func(edges_[i]);
+    }
+    remaining_--;
+  }
+};
+
+// Generation-tagged reference to a node in the arena
+// A reference whose submission has been released no longer matches the generation of its slot
+struct TaskRef {
+  uint32_t slot;
+  uint32_t generation;
+  uint32_t node;
+};
+
+// Entry of the ready queue; all keys are stored inline so that comparisons need no lookups
+struct ReadyTask {
+  long priority;
+  long submission_internal_id;
+  int task_order;
+  TaskRef ref;
+
+  bool operator<(const ReadyTask& x) const {
+    // larger priority first, then smaller submission id, task order and node index
+    if (priority != x.priority) return priority < x.priority;
+    if (submission_internal_id != x.submission_internal_id) {
+      return submission_internal_id > x.submission_internal_id;
+    }
+    if (task_order != x.task_order) return task_order > x.task_order;
+    return ref.node > x.ref.node;
+  }
+};
+using ReadyQueue = std::priority_queue<ReadyTask>;
+
+// One slot per queued submission; slots (and the storage of their graphs) are reused
+//  after the submission finishes
+class TaskArena {
+ public:
+  struct Slot {
+    uint32_t generation;
+    bool in_use;
+    long submission_internal_id;
+    long priority;
+    SubmissionAndResult* sub;
+    TaskGraph graph;
+  };
+
+ private:
+  // deque keeps references to slots valid when growing
+  std::deque<Slot> slots_;
+  std::vector<uint32_t> free_slots_;
+
+ public:
+  uint32_t Allocate(long submission_internal_id, long priority, SubmissionAndResult* sub);
+  void Release(uint32_t slot);
+
+  Slot& operator[](uint32_t slot) { return slots_[slot]; }
+  // nullptr if the reference is stale
+  Slot* Get(const TaskRef& ref) {
+    if (ref.slot >= slots_.size()) return nullptr;
+    Slot& slot = slots_[ref.slot];
+    return slot.in_use && slot.generation == ref.generation ? &slot : nullptr;
+  }
+  ReadyTask MakeReady(uint32_t slot, uint32_t node) const {
+    const Slot& s = slots_[slot];
+    return {s.priority, s.submission_internal_id, s.graph[node].task_order, {slot, s.generation, node}};
+  }
+};
+
+#endif  // TIOJ_TASK_GRAPH_H_
@@ -1,12 +1,12 @@
 #include "tasks.h"
 
 #include <fcntl.h>
-#include <signal.h>
 #include <unistd.h>
 #include <wordexp.h>
-#include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/sysinfo.h>
-#include <map>
+#include <limits>
 #include <numeric>
 #include <unordered_map>
 
@@ -18,7 +18,8 @@
 namespace {
 
 std::vector<std::string> GccCompileCommand(
-    Compiler lang, const std::string& input, const std::string& interlib, const std::string& output, bool is_static) {
+    Compiler lang, const std::string& input, const std::string& interlib, const std::string& output, bool is_static,
+    const std::string& include_dir) {
   std::string prog, std;
   switch (lang) {
     case Compiler::GCC_CPP_98: prog = "g++", std = "-std=c++98"; break;
@@ -34,6 +35,8 @@ std::vector<std::string> GccCompileCommand(
   }
   std::vector<std::string> ret = {"/usr/bin/env", prog, std, "-O2", "-w"};
   if (is_static) ret.push_back("-static");
+  // searched for #include "..." after the directory of the source, just like files placed beside it
+  if (!include_dir.empty()) ret.insert(ret.end(), {"-iquote", include_dir});
   ret.insert(ret.end(), {"-o", output, input});
   if (!interlib.empty()) ret.push_back(interlib);
   if (prog == "gcc") ret.push_back("-lm");
@@ -59,10 +62,40 @@ std::vector<std::string> ExecuteCommand(Compiler lang, const std::string& progra
   __builtin_unreachable();
 }
 
-/// child
-// Invoke sandbox with correct settings
+// Replace $VAR and ${VAR} by the given values as the shell does, so that we don't need to modify
+//  the environment of the judge before wordexp
+std::string ExpandVars(const std::string& str, const std::vector<std::pair<std::string, std::string>>& vars) {
+  auto IsNameChar = [](char c) { return isalnum((unsigned char)c) || c == '_'; };
+  std::string ret;
+  for (size_t i = 0; i < str.size(); i++) {
+    if (str[i] == '$') {
+      bool found = false;
+      for (auto& [name, value] : vars) {
+        if (str.compare(i + 1, name.size(), name) == 0 &&
+            (i + 1 + name.size() == str.size() || !IsNameChar(str[i + 1 + name.size()]))) {
+          ret += value;
+          i += name.size();
+          found = true;
+          break;
+        } else if (str.compare(i + 1, name.size() + 2, "{" + name + "}") == 0) {
+          ret += value;
+          i += name.size() + 2;
+          found = true;
+          break;
+        }
+      }
+      if (found) continue;
+    }
+    ret.push_back(str[i]);
+  }
+  return ret;
+}
+
+/// sandbox options
+// Generate sandbox settings of each task type; return false if failed
 // Results will be parsed in testsuite.cpp
-struct cjail_result RunCompile(const SubmissionAndResult& sub_and_result, const Task& task, int uid, int cpuid) {
+bool CompileOptions(const SubmissionAndResult& sub_and_result, const Task& task, int uid, int cpuid,
+                    SandboxOptions& opt) {
   const Submission& sub = sub_and_result.sub;
   long id = sub.submission_internal_id;
   CompileSubtask subtask = (CompileSubtask)task.subtask;
@@ -85,8 +118,9 @@ struct cjail_result RunCompile(const SubmissionAndResult& sub_and_result, const
   }
   std::string input = CompileBoxInput(-1, subtask, lang, true);
   std::string output = CompileBoxOutput(-1, subtask, lang, true);
+  // judge headers are bound read-only at the same path (see opt.dirs below)
+  std::string headers = subtask == CompileSubtask::USERPROG ? "" : SpecjudgeHeadersPath().string();
 
-  SandboxOptions opt;
   opt.boxdir = CompileBoxPath(id, subtask);
   switch (lang) {
     case Compiler::GCC_CPP_98: [[fallthrough]];
@@ -98,7 +132,7 @@ struct cjail_result RunCompile(const SubmissionAndResult& sub_and_result, const
     case Compiler::GCC_C_99: [[fallthrough]];
     case Compiler::GCC_C_11: [[fallthrough]];
     case Compiler::GCC_C_17:
-      opt.command = GccCompileCommand(lang, input, interlib, output, sub.sandbox_strict); break;
+      opt.command = GccCompileCommand(lang, input, interlib, output, sub.sandbox_strict, headers); break;
     case Compiler::HASKELL: {
       opt.command = {"/usr/bin/env", "ghc", "-w", "-O", "-tmpdir", ".", "-o", output, input};
       if (sub.sandbox_strict) {
@@ -124,20 +158,20 @@ struct cjail_result RunCompile(const SubmissionAndResult& sub_and_result, const
   if (subtask != CompileSubtask::SUMMARY) { // add custom arguments
     auto& additional_args = subtask == CompileSubtask::USERPROG ? sub.user_compile_args : sub.specjudge_compile_args;
     if (additional_args.size()) {
-      setenv("INPUT", input.c_str(), 1);
-      setenv("OUTPUT", output.c_str(), 1);
-      if (wordexp_t args; wordexp(additional_args.c_str(), &args, WRDE_NOCMD) == 0) {
+      std::string expanded = ExpandVars(additional_args, {{"INPUT", input}, {"OUTPUT", output}, {"HEADERS", headers}});
+      if (wordexp_t args; wordexp(expanded.c_str(), &args, WRDE_NOCMD) == 0) {
         for (size_t i = 0; i < args.we_wordc; i++) opt.command.push_back(args.we_wordv[i]);
         wordfree(&args);
       }
-      unsetenv("INPUT");
-      unsetenv("OUTPUT");
     }
   }
   if (char* path = getenv("PATH")) opt.envs.push_back(std::string("PATH=") + path);
+  // also for custom compile commands (searched as with -I)
+  if (headers.size()) opt.envs.push_back("CPATH=" + headers);
   opt.workdir = Workdir("/");
   opt.input = "/dev/null";
-  opt.fd_output = open(CompileBoxMessage(id, subtask).c_str(), O_WRONLY | O_APPEND | O_CREAT, 0666);
+  opt.fd_output = open(CompileBoxMessage(id, subtask).c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0666);
+  if (opt.fd_output < 0) return false;
   opt.fd_error = opt.fd_output;
   if (cpuid != -1) opt.cpu_set.push_back(cpuid);
   opt.uid = opt.gid = uid;
@@ -147,13 +181,14 @@ struct cjail_result RunCompile(const SubmissionAndResult& sub_and_result, const
   opt.proc_num = 10;
   opt.fsize = kMaxOutput;
   opt.dirs = {"/usr", "/var/lib", "/lib", "/lib64", "/etc/alternatives", "/bin"};
+  if (headers.size()) opt.dirs.push_back(headers);
   opt.FilterDirs();
-  return SandboxExec(opt);
-  // we don't need to close the opened files because the process is about to terminate
+  return true;
 }
 
 // TODO FEATURE(io-interactive): fork & run multiple cjails and merge them into one cjail_result
-struct cjail_result RunExecute(const SubmissionAndResult& sub_and_result, const Task& task, int uid, int cpuid) {
+bool ExecuteOptions(const SubmissionAndResult& sub_and_result, const Task& task, int uid, int cpuid,
+                    SandboxOptions& opt) {
   const Submission& sub = sub_and_result.sub;
   long id = sub.submission_internal_id;
   int subtask = task.subtask;
@@ -163,7 +198,6 @@ struct cjail_result RunExecute(const SubmissionAndResult& sub_and_result, const
   auto& lim = sub.testdata[subtask];
   std::string program = ExecuteBoxProgram(-1, -1, -1, sub.lang, true);
 
-  SandboxOptions opt;
   opt.boxdir = ExecuteBoxPath(id, subtask, stage);
   opt.command = ExecuteCommand(sub.lang, program);
   if (sub.stages > 1) opt.command.push_back(std::to_string(stage));
@@ -192,39 +226,52 @@ struct cjail_result RunExecute(const SubmissionAndResult& sub_and_result, const
       // TODO: is it possible to run without /usr/bin and /bin? (maybe copy python executable to workdir)
       opt.dirs = {"/usr", "/lib", "/lib64", "/etc/alternatives", "/bin"};
     }
-    int fd_input = open(ExecuteBoxInput(id, subtask, stage, sub.sandbox_strict).c_str(), O_RDONLY);
-    int fd_output = open(ExecuteBoxOutput(id, subtask, stage, sub.sandbox_strict).c_str(), O_WRONLY | O_CREAT, 0600);
-    int pipes[2][2];
-    if (pipe(pipes[0]) < 0 || !SpliceProcess(fd_input, pipes[0][1]) || close(pipes[0][1]) < 0 ||
-        pipe(pipes[1]) < 0 || !SpliceProcess(pipes[1][0], fd_output, opt.fsize * 1024) || close(pipes[1][0]) < 0) {
-      // after returned, this process will terminate, closing the pipes and cause SpliceProcess' (if any) to exit
-      goto err;
+    // the files are relayed through pipes by sandbox-exec
+    if (stage == 0 && kBindTestdata) {
+      // not staged by SetupExecute; the relay reads the testdata directly
+      auto lck = td_file_lock.Shared(sub.problem_id);
+      opt.fd_input = open(lim.input_file.c_str(), O_RDONLY | O_CLOEXEC);
+    } else {
+      opt.fd_input = open(ExecuteBoxInput(id, subtask, stage, sub.sandbox_strict).c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    opt.fd_output = open(ExecuteBoxOutput(id, subtask, stage, sub.sandbox_strict).c_str(),
+                         O_WRONLY | O_CREAT | O_CLOEXEC, 0600);
+    if (opt.fd_input < 0 || opt.fd_output < 0) {
+      spdlog::warn("Failed to open execute input/output: errno={} {}", errno, strerror(errno));
+      return false;
     }
-    close(fd_input), close(fd_output);
-    opt.fd_input = pipes[0][0];
-    opt.fd_output = pipes[1][1];
+    opt.relay_fds = true;
     opt.error = "/dev/null";
   } else {
     opt.dirs = {"/usr", "/lib", "/lib64", "/etc/alternatives", "/bin"};
-    opt.input = ExecuteBoxInput(-1, -1, -1, sub.sandbox_strict, true);
-    opt.output = ExecuteBoxOutput(-1, -1, -1, sub.sandbox_strict, true);
+    // the files are passed directly instead of being mounted into the box; the output goes into
+    //  ExecuteBoxFinalOutput, outside of the tmpfs, so that it can be handed to the scoring box and
+    //  later stages without copying (its size is still limited by fsize)
+    if (stage == 0 && kBindTestdata) {
+      auto lck = td_file_lock.Shared(sub.problem_id);
+      opt.fd_input = open(lim.input_file.c_str(), O_RDONLY | O_CLOEXEC);
+    } else if (stage == 0) {
+      opt.fd_input = open(ExecuteBoxInput(id, subtask, stage, sub.sandbox_strict).c_str(), O_RDONLY | O_CLOEXEC);
+    } else {
+      opt.fd_input = open(ExecuteBoxFinalOutput(id, subtask, stage - 1).c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    opt.fd_output = open(ExecuteBoxFinalOutput(id, subtask, stage).c_str(),
+                         O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (opt.fd_input < 0 || opt.fd_output < 0) {
+      spdlog::warn("Failed to open execute input/output: errno={} {}", errno, strerror(errno));
+      return false;
+    }
     opt.error = ExecuteBoxError(-1, -1, -1, true);
     // Output file is accounted in cgroups, so we need to extend RSS limit
     // MLE check will still be done by the original limit
     opt.rss += opt.fsize;
   }
   opt.FilterDirs();
-  // we don't need to close the opened files because the process is about to terminate
-  return SandboxExec(opt);
- err:
-  spdlog::warn("SandboxExec error: errno={} {}", errno, strerror(errno));
-  struct cjail_result ret;
-  ret.oomkill = errno;
-  ret.timekill = -1;
-  return ret;
+  return true;
 }
 
-struct cjail_result RunScoring(const SubmissionAndResult& sub_and_result, const Task& task, int uid, int cpuid) {
+bool ScoringOptions(const SubmissionAndResult& sub_and_result, const Task& task, int uid, int cpuid,
+                    SandboxOptions& opt) {
   const Submission& sub = sub_and_result.sub;
   long id = sub.submission_internal_id;
   int subtask = task.subtask;
@@ -232,7 +279,6 @@ struct cjail_result RunScoring(const SubmissionAndResult& sub_and_result, const
   spdlog::debug("Generating scoring settings: id={} subid={}, subtask={}", id, sub.submission_id, task.subtask);
   std::string program = ScoringBoxProgram(-1, -1, -1, sub.specjudge_lang, true);
 
-  SandboxOptions opt;
   opt.boxdir = ScoringBoxPath(id, subtask, stage);
   opt.command = ExecuteCommand(sub.specjudge_lang, program);
   if (sub.specjudge_type == SpecjudgeType::SPECJUDGE_OLD) {
@@ -263,16 +309,16 @@ struct cjail_result RunScoring(const SubmissionAndResult& sub_and_result, const
   opt.fsize = kMaxOutput;
   opt.dirs = {"/usr", "/var/lib", "/lib", "/lib64", "/etc/alternatives", "/bin"};
   opt.FilterDirs();
-  return SandboxExec(opt);
+  return true;
 }
 
-struct cjail_result RunSummary(const SubmissionAndResult& sub_and_result, const Task& task, int uid, int cpuid) {
+bool SummaryOptions(const SubmissionAndResult& sub_and_result, const Task& task, int uid, int cpuid,
+                    SandboxOptions& opt) {
   const Submission& sub = sub_and_result.sub;
   long id = sub.submission_internal_id;
   spdlog::debug("Generating summary settings: id={} subid={}", id, sub.submission_id);
   std::string program = SummaryBoxProgram(-1, sub.summary_lang, true);
 
-  SandboxOptions opt;
   opt.boxdir = SummaryBoxPath(id);
   opt.command = ExecuteCommand(sub.summary_lang, program);
   opt.command.push_back(SummaryBoxMetaFile(-1, true));
@@ -289,7 +335,7 @@ struct cjail_result RunSummary(const SubmissionAndResult& sub_and_result, const
   opt.fsize = kMaxOutput;
   opt.dirs = {"/usr", "/var/lib", "/lib", "/lib64", "/etc/alternatives", "/bin"};
   opt.FilterDirs();
-  return SandboxExec(opt);
+  return true;
 }
 
 /// parent
@@ -297,52 +343,101 @@ constexpr int kUidBase = 50000, kUidPoolSize = 100;
 std::vector<int> uid_pool, cpuid_pool;
 bool pool_init = false;
 
-fd_set running_fdset;
-std::map<int, std::tuple<int, int, int>> running; // fd -> (pid, uid, cpuid)
-std::unordered_map<int, struct cjail_result> finished; // fd -> result
+// Completion engine: every running task registers the socket of its sandbox-exec worker in an epoll
+//  instance, so each completion costs O(1) regardless of the number of running tasks and there is no
+//  limit on fd numbers. The socket is also hung up if the worker dies, so a result is never lost.
+// Handles are sequence numbers, since worker sockets are reused across tasks.
+struct RunningTask {
+  int worker;
+  int uid, cpuid;
+};
+std::unordered_map<int, RunningTask> running; // handle -> task
+std::unordered_map<int, struct cjail_result> finished; // handle -> result
+int handle_seq = 0;
+
+enum EventKind : uint64_t { kWorker, kWakeup };
+inline uint64_t EventData(int handle, EventKind kind) { return (uint64_t)handle << 1 | kind; }
+
+int epoll_fd = -1;
+bool pending_interrupt = false;
+
+// signalled by InterruptWait(); initialized on first use since it can be called from any thread
+int WakeupFd() {
+  static int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  return fd;
+}
 
 void InitPools() {
   for (int i = 0; i < kUidPoolSize; i++) uid_pool.push_back(i + kUidBase);
   for (int i = 0, N = get_nprocs(); i < N; i++) {
     if (CPU_ISSET(i, &kPinnedCpus)) cpuid_pool.push_back(i);
   }
-  FD_ZERO(&running_fdset);
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  struct epoll_event ev = {};
+  ev.events = EPOLLIN;
+  ev.data.u64 = EventData(0, kWakeup);
+  if (epoll_fd < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, WakeupFd(), &ev) < 0) {
+    spdlog::error("Failed to initialize epoll: {}", strerror(errno));
+  }
   pool_init = true;
 }
 
-bool Wait() {
+void ReleaseIds(int uid, int cpuid) {
+  uid_pool.push_back(uid);
+  if (cpuid != -1) cpuid_pool.push_back(cpuid);
+}
+
+// Collect the result of a task whose worker socket is readable
+void CompleteTask(int handle) {
+  auto it = running.find(handle);
+  RunningTask& task = it->second;
+  epoll_ctl(epoll_fd, EPOLL_CTL_DEL, SandboxWorkerFd(task.worker), nullptr);
+  finished[handle] = SandboxWorkerResult(task.worker);
+  spdlog::debug("Task handle={} finished", handle);
+  ReleaseIds(task.uid, task.cpuid);
+  running.erase(it);
+}
+
+// return false if interrupted or error
+bool Wait(bool interruptible) {
+  if (interruptible && pending_interrupt) {
+    pending_interrupt = false;
+    return false;
+  }
   if (running.empty()) return false;
-  int max_fd = running.rbegin()->first;
-  fd_set select_fdset = running_fdset;
-  if (select(max_fd + 1, &select_fdset, nullptr, nullptr, nullptr) <= 0) return false;
-  std::vector<int> to_remove;
-  for (auto& i : running) {
-    if (!FD_ISSET(i.first, &select_fdset)) continue;
-    spdlog::debug("Task handle={} finished", i.first);
-    struct cjail_result res = {};
-    IGNORE_RETURN(read(i.first, &res, sizeof(struct cjail_result)));
-    // we don't close(i.first) here, because it will release the handle and make it clash
-    waitpid(std::get<0>(i.second), nullptr, 0);
-    uid_pool.push_back(std::get<1>(i.second));
-    if (int cpuid = std::get<2>(i.second); cpuid != -1) {
-      cpuid_pool.push_back(cpuid);
+  constexpr int kMaxEvents = 64;
+  struct epoll_event events[kMaxEvents];
+  int num = epoll_wait(epoll_fd, events, kMaxEvents, -1);
+  if (num <= 0) return false;
+  bool interrupted = false, completed = false;
+  for (int i = 0; i < num; i++) {
+    EventKind kind = (EventKind)(events[i].data.u64 & 1);
+    int handle = events[i].data.u64 >> 1;
+    if (kind == kWakeup) {
+      eventfd_t val;
+      eventfd_read(WakeupFd(), &val);
+      // keep the interruption for the next interruptible wait
+      if (interruptible) {
+        interrupted = true;
+      } else {
+        pending_interrupt = true;
+      }
+      continue;
     }
-    finished[i.first] = res;
-    to_remove.push_back(i.first);
+    if (!running.count(handle)) continue;
+    // result written, or worker died
+    CompleteTask(handle);
+    completed = true;
   }
-  for (int i : to_remove) {
-    running.erase(i);
-    FD_CLR(i, &running_fdset);
-  }
-  return true;
+  return !interrupted || completed;
 }
 
 } // namespace
 
 int RunTask(const SubmissionAndResult& sub, const Task& task) {
   if (!pool_init) InitPools();
-  int pipefd[2];
-  if (pipe(pipefd) < 0) return -1;
+  int handle = handle_seq++;
+  if (handle_seq == std::numeric_limits<int>::max()) handle_seq = 0;
   int uid = uid_pool.back();
   uid_pool.pop_back();
   int cpuid = -1;
@@ -354,40 +449,55 @@ int RunTask(const SubmissionAndResult& sub, const Task& task) {
     cpuid = cpuid_pool.back();
     cpuid_pool.pop_back();
   }
-  pid_t pid = fork();
-  if (pid < 0) {
-    uid_pool.push_back(uid);
-    if (cpuid != -1) cpuid_pool.push_back(cpuid);
-    close(pipefd[0]);
-    close(pipefd[1]);
-    return pid; // error
+  SandboxOptions opt;
+  bool res = false;
+  switch (task.type) {
+    case TaskType::COMPILE: res = CompileOptions(sub, task, uid, cpuid, opt); break;
+    case TaskType::EXECUTE: res = ExecuteOptions(sub, task, uid, cpuid, opt); break;
+    case TaskType::SCORING: res = ScoringOptions(sub, task, uid, cpuid, opt); break;
+    case TaskType::SUMMARY: res = SummaryOptions(sub, task, uid, cpuid, opt); break;
+    case TaskType::FETCH_TESTDATA: break; // never run in a sandbox
   }
-  if (pid == 0) {
-    close(pipefd[0]);
-    struct cjail_result ret;
-    switch (task.type) {
-      case TaskType::COMPILE: ret = RunCompile(sub, task, uid, cpuid); break;
-      case TaskType::EXECUTE: ret = RunExecute(sub, task, uid, cpuid); break;
-      case TaskType::SCORING: ret = RunScoring(sub, task, uid, cpuid); break;
-      case TaskType::SUMMARY: ret = RunSummary(sub, task, uid, cpuid); break;
-    }
-    IGNORE_RETURN(write(pipefd[1], &ret, sizeof(struct cjail_result)));
-    _exit(0); // since forked, some atexit() may hang by deadlocks
+  int worker = res ? SandboxExecAsync(opt) : -1;
+  int err = errno;
+  // the fds are passed to the worker
+  if (opt.fd_input != -1) close(opt.fd_input);
+  if (opt.fd_output != -1) close(opt.fd_output);
+  if (opt.fd_error != -1 && opt.fd_error != opt.fd_output) close(opt.fd_error);
+  if (worker < 0) {
+    spdlog::warn("Failed to start task type={} subtask={} of {}: errno={} {}",
+                 TaskTypeName(task.type), task.subtask, sub.sub.submission_internal_id, err, strerror(err));
+    ReleaseIds(uid, cpuid);
+    struct cjail_result ret = {};
+    ret.oomkill = err;
+    ret.timekill = -1;
+    finished[handle] = ret;
+    return handle;
   }
-  close(pipefd[1]);
-  running[pipefd[0]] = {pid, uid, cpuid};
-  FD_SET(pipefd[0], &running_fdset);
-  spdlog::debug("Task type={} subtask={} of {} started, handle={} pid={} uid={} cpuid={}",
-                TaskTypeName(task.type), task.subtask, sub.sub.submission_internal_id, pipefd[0], pid, uid, cpuid);
-  return pipefd[0];
+  running[handle] = {worker, uid, cpuid};
+  struct epoll_event ev = {};
+  ev.events = EPOLLIN;
+  ev.data.u64 = EventData(handle, kWorker);
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, SandboxWorkerFd(worker), &ev);
+  spdlog::debug("Task type={} subtask={} of {} started, handle={} uid={} cpuid={} worker={}",
+                TaskTypeName(task.type), task.subtask, sub.sub.submission_internal_id, handle, uid, cpuid, worker);
+  return handle;
+}
+
+bool KillTask(int handle) {
+  auto it = running.find(handle);
+  if (it == running.end()) return false;
+  spdlog::debug("Killing task handle={} worker={}", handle, it->second.worker);
+  SandboxWorkerKill(it->second.worker);
+  return true;
 }
 
 std::pair<int, struct cjail_result> WaitAnyResult() {
   if (running.empty() && finished.empty()) return {-1, {}};
-  if (finished.empty()) Wait();
+  if (finished.empty()) Wait(true);
+  if (finished.empty()) return {-1, {}}; // interrupted
   auto ret = *finished.begin();
   finished.erase(finished.begin());
-  close(ret.first); // delay close
   spdlog::debug("Task handle={} returned", ret.first);
   return ret;
 }
@@ -399,22 +509,26 @@ std::pair<int, struct cjail_result> WaitAnyResult(const std::vector<int>& handle
     if (it != finished.end()) {
       auto ret = *it;
       finished.erase(it);
+      spdlog::debug("Task handle={} returned", ret.first);
       return ret;
     }
     if (!flag && running.count(i)) flag = true;
   }
   if (!flag) return {-1, {}};
   while (true) {
-    Wait();
+    Wait(false);
     for (int i : handles) {
       auto it = finished.find(i);
       if (it != finished.end()) {
         auto ret = *it;
         finished.erase(it);
-        close(ret.first); // delay close
         spdlog::debug("Task handle={} returned", ret.first);
         return ret;
       }
     }
   }
 }
+
+void InterruptWait() {
+  eventfd_write(WakeupFd(), 1);
+}
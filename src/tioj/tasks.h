@@ -12,14 +12,22 @@ struct Task {
   int stage;
 };
 
-// We're not sure whether cjail is thread-safe. Thus, we use fork() for every RunTask,
-//  and provide an asynchronous interface to deal with tasks.
+// We're not sure whether cjail is thread-safe. Thus, cjail runs in sandbox-exec worker processes
+//  (see sandbox_exec.h), and we provide an asynchronous interface to deal with tasks.
 
-// RunTask returns a handle to obtain result
+// RunTask returns a handle to obtain result; if the task cannot be started, the result is an error
 int RunTask(const SubmissionAndResult&, const Task&);
 
 // return (handle, result); handle = -1 if error
+// WaitAnyResult() also returns handle = -1 if interrupted by InterruptWait()
 std::pair<int, struct cjail_result> WaitAnyResult();
 std::pair<int, struct cjail_result> WaitAnyResult(const std::vector<int>& handles);
 
+// SIGKILL the sandbox of a running task; its result is still returned by WaitAnyResult()
+// return false if the task has already finished
+bool KillTask(int handle);
+
+// Called from any thread; make a blocking (or the next) WaitAnyResult() return immediately
+void InterruptWait();
+
 #endif // TIOJ_TASKS_H_
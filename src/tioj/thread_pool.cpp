@@ -0,0 +1,35 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(int num_threads) : stop_(false) {
+  for (int i = 0; i < num_threads; i++) threads_.emplace_back(&ThreadPool::Worker, this);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard lck(mtx_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  for (auto& i : threads_) i.join();
+}
+
+void ThreadPool::Submit(std::function<void()>&& job) {
+  {
+    std::lock_guard lck(mtx_);
+    jobs_.push(std::move(job));
+  }
+  cv_.notify_one();
+}
+
+void ThreadPool::Worker() {
+  std::unique_lock lck(mtx_);
+  while (true) {
+    cv_.wait(lck, [this]{ return stop_ || !jobs_.empty(); });
+    if (jobs_.empty()) return;
+    auto job = std::move(jobs_.front());
+    jobs_.pop();
+    lck.unlock();
+    job();
+    lck.lock();
+  }
+}
@@ -0,0 +1,29 @@
+#ifndef TIOJ_THREAD_POOL_H_
+#define TIOJ_THREAD_POOL_H_
+
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+// A fixed-size pool of threads running jobs in FIFO order
+class ThreadPool {
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::queue<std::function<void()>> jobs_;
+  std::vector<std::thread> threads_;
+  bool stop_;
+
+  void Worker();
+ public:
+  explicit ThreadPool(int num_threads);
+  // wait for all submitted jobs to finish
+  ~ThreadPool();
+
+  void Submit(std::function<void()>&& job);
+  size_t NumThreads() const { return threads_.size(); }
+};
+
+#endif  // TIOJ_THREAD_POOL_H_
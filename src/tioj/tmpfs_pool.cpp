@@ -0,0 +1,108 @@
+#include "tmpfs_pool.h"
+
+#include <sys/mount.h>
+
+#include <spdlog/spdlog.h>
+#include "utils.h"
+
+namespace {
+
+// same flags are needed on remount, otherwise they are cleared
+constexpr unsigned long kMountFlags = MS_NOSUID | MS_NODEV;
+
+inline std::string MountData(long size_kib) {
+  // the root of the tmpfs is the root of the box, so it should not be writable
+  return "size=" + std::to_string(size_kib) + "k,mode=755";
+}
+
+} // namespace
+
+TmpfsPool::TmpfsPool(const fs::path& root) : root_(root), total_(0), next_id_(0) {
+  UmountAll(root_);
+  RemoveAll(root_);
+  CreateDirs(root_);
+}
+
+fs::path TmpfsPool::MountNew() {
+  fs::path path;
+  {
+    std::lock_guard lck(mtx_);
+    path = root_ / std::to_string(next_id_++);
+    total_++;
+  }
+  if (!CreateDirs(path) || mount("tmpfs", path.c_str(), "tmpfs", kMountFlags, MountData(4).c_str()) < 0) {
+    spdlog::warn("Failed mounting tmpfs on {}: {}", path.c_str(), strerror(errno));
+    RemoveAll(path);
+    std::lock_guard lck(mtx_);
+    total_--;
+    return fs::path();
+  }
+  spdlog::debug("Mount pooled tmpfs on {}", path.c_str());
+  return path;
+}
+
+void TmpfsPool::Drop(const fs::path& path) {
+  if (umount2(path.c_str(), MNT_DETACH) < 0) {
+    spdlog::warn("Failed unmounting {}: {}", path.c_str(), strerror(errno));
+  }
+  RemoveAll(path);
+}
+
+void TmpfsPool::Fill(size_t n) {
+  while (Size() < n) {
+    fs::path path = MountNew();
+    if (path.empty()) return;
+    std::lock_guard lck(mtx_);
+    idle_.push_back(path);
+  }
+}
+
+fs::path TmpfsPool::Acquire(long size_kib) {
+  fs::path path;
+  {
+    std::lock_guard lck(mtx_);
+    if (idle_.size()) {
+      path = std::move(idle_.back());
+      idle_.pop_back();
+    }
+  }
+  if (path.empty()) path = MountNew();
+  if (path.empty()) return path;
+  spdlog::debug("Remount pooled tmpfs {}, size {}", path.c_str(), size_kib);
+  if (mount(nullptr, path.c_str(), nullptr, MS_REMOUNT | kMountFlags, MountData(size_kib).c_str()) < 0) {
+    spdlog::warn("Failed remounting tmpfs {}: {}", path.c_str(), strerror(errno));
+    Drop(path);
+    std::lock_guard lck(mtx_);
+    total_--;
+    return fs::path();
+  }
+  return path;
+}
+
+void TmpfsPool::Release(const fs::path& path, size_t keep) {
+  bool wiped = true;
+  std::error_code ec;
+  for (auto& entry : fs::directory_iterator(path, ec)) {
+    fs::remove_all(entry.path(), ec);
+    if (ec) break;
+  }
+  if (ec) {
+    // possibly something is still mounted inside
+    spdlog::warn("Failed wiping pooled tmpfs {}: {}", path.c_str(), ec.message());
+    wiped = false;
+  }
+  {
+    std::lock_guard lck(mtx_);
+    if (wiped && idle_.size() < keep) {
+      idle_.push_back(path);
+      return;
+    }
+    total_--;
+  }
+  Drop(path);
+}
+
+size_t TmpfsPool::Size() {
+  std::lock_guard lck(mtx_);
+  return total_;
+}
@@ -0,0 +1,36 @@
+#ifndef TIOJ_TMPFS_POOL_H_
+#define TIOJ_TMPFS_POOL_H_
+
+#include <mutex>
+#include <vector>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+// Pre-mounted tmpfs directories under root, recycled as the boxes of non-strict executes
+// Reusing one only takes a remount (to set its size) and a wipe, which do not change the mount tree
+//  as mount & umount do; all members are thread-safe
+class TmpfsPool {
+  std::mutex mtx_;
+  fs::path root_;
+  std::vector<fs::path> idle_;
+  size_t total_; // idle and in use
+  size_t next_id_;
+
+  fs::path MountNew();
+  void Drop(const fs::path&);
+ public:
+  // leaked mounts of a previous run under root are unmounted; likewise, mounts are left as-is
+  //  on destruction, since this is usually destructed on exit
+  explicit TmpfsPool(const fs::path& root);
+
+  // mount new ones until there are at least n
+  void Fill(size_t n);
+  // return a mounted directory of the given size, or an empty path if failed
+  fs::path Acquire(long size_kib);
+  // wipe it and keep it if there are fewer than keep idle ones; otherwise unmount it
+  void Release(const fs::path&, size_t keep);
+  size_t Size();
+};
+
+#endif  // TIOJ_TMPFS_POOL_H_
@@ -0,0 +1,83 @@
+#include "trash.h"
+
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/ioprio.h>
+
+#include <spdlog/spdlog.h>
+#include "utils.h"
+
+Trash::Trash(const fs::path& root, long budget_bytes) :
+    root_(root), budget_(budget_bytes), bytes_(0), next_id_(0), stop_(false) {
+  CreateDirs(root_);
+  std::error_code ec;
+  for (auto& entry : fs::directory_iterator(root_, ec)) {
+    // keep the names unique
+    try {
+      next_id_ = std::max(next_id_, std::stol(entry.path().filename()) + 1);
+    } catch (std::exception&) {}
+    queue_.emplace_back(entry.path(), DiskUsage(entry.path()));
+    bytes_ += queue_.back().second;
+  }
+  thread_ = std::thread(&Trash::Collect, this);
+}
+
+Trash::~Trash() {
+  {
+    std::lock_guard lck(mtx_);
+    stop_ = true;
+  }
+  cv_.notify_one();
+  thread_.join();
+}
+
+void Trash::Collect() {
+  // nice & ioprio apply to the calling thread only
+  pid_t tid = syscall(SYS_gettid);
+  if (setpriority(PRIO_PROCESS, tid, 19) < 0 ||
+      syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid, IOPRIO_PRIO_VALUE(IOPRIO_CLASS_IDLE, 0)) < 0) {
+    spdlog::warn("Failed lowering the priority of the trash collector: {}", strerror(errno));
+  }
+  std::unique_lock lck(mtx_);
+  while (true) {
+    cv_.wait(lck, [&]{ return stop_ || !queue_.empty(); });
+    if (stop_) return;
+    auto [path, size] = queue_.front();
+    lck.unlock();
+    RemoveAll(path);
+    lck.lock();
+    queue_.pop_front();
+    bytes_ -= size;
+    spdlog::debug("Trash collected {}, backlog {} entries {} bytes", path.c_str(), queue_.size(), bytes_);
+    space_cv_.notify_all();
+  }
+}
+
+void Trash::Discard(const fs::path& path) {
+  fs::path dest;
+  {
+    std::lock_guard lck(mtx_);
+    dest = root_ / std::to_string(next_id_++);
+  }
+  long size = DiskUsage(path);
+  if (rename(path.c_str(), dest.c_str()) < 0) {
+    if (errno != ENOENT) {
+      spdlog::debug("Failed moving {} to trash: {}", path.c_str(), strerror(errno));
+      RemoveAll(path);
+    }
+    return;
+  }
+  spdlog::debug("Discard {} as {}, {} bytes", path.c_str(), dest.c_str(), size);
+  std::unique_lock lck(mtx_);
+  // back-pressure; an entry larger than the budget is still accepted when the trash is empty
+  space_cv_.wait(lck, [&]{ return stop_ || queue_.empty() || bytes_ + size <= budget_; });
+  queue_.emplace_back(std::move(dest), size);
+  bytes_ += size;
+  cv_.notify_one();
+}
+
+Trash::Backlog Trash::GetBacklog() {
+  std::lock_guard lck(mtx_);
+  return {queue_.size(), bytes_};
+}
@@ -0,0 +1,44 @@
+#ifndef TIOJ_TRASH_H_
+#define TIOJ_TRASH_H_
+
+#include <mutex>
+#include <deque>
+#include <thread>
+#include <filesystem>
+#include <condition_variable>
+
+namespace fs = std::filesystem;
+
+// Files and directories to be deleted are renamed into root at once, and deleted later by a
+//  background thread with the lowest CPU and IO priority; all members are thread-safe
+class Trash {
+  std::mutex mtx_;
+  std::condition_variable cv_; // wakes the collector
+  std::condition_variable space_cv_; // wakes Discard waiting for the budget
+  std::deque<std::pair<fs::path, long>> queue_; // with size in bytes
+  fs::path root_;
+  long budget_;
+  long bytes_;
+  long next_id_;
+  bool stop_;
+  std::thread thread_;
+
+  void Collect();
+ public:
+  // entries left in root by a previous run are collected as well
+  Trash(const fs::path& root, long budget_bytes);
+  // the remaining backlog is left in root
+  ~Trash();
+
+  // the path is removed in place if it cannot be renamed into root (e.g. on another filesystem);
+  //  blocks while the backlog exceeds the byte budget
+  void Discard(const fs::path&);
+
+  struct Backlog {
+    size_t entries;
+    long bytes;
+  };
+  Backlog GetBacklog();
+};
+
+#endif  // TIOJ_TRASH_H_
@@ -2,45 +2,79 @@
 
 #include <fcntl.h>
 #include <unistd.h>
-#include <sys/wait.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
 #include <sys/mount.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
 #include <atomic>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <set>
 
 #include <spdlog/spdlog.h>
 
 namespace {
 
 std::atomic_long submission_internal_id_seq = 0;
+std::atomic_long transfer_files = 0, transfer_bytes = 0, transfer_usec = 0;
 
-#if __has_include(<linux/close_range.h>)
-#include <linux/close_range.h>
-int CloseFrom(int minfd) {
-  return close_range(minfd, ~0U, 0);
-}
-#else
-#include <dirent.h>
-int CloseFrom(int minfd) {
-  DIR *fddir = opendir("/proc/self/fd");
-  if (!fddir) goto error;
+// Copy the content of from into to, which is created (or truncated) with the given permissions,
+//  or those of from if unknown; try reflink, then in-kernel copy, then sendfile
+// Returns false with errno set on failure
+bool TransferFile(const fs::path& from, const fs::path& to, fs::perms perms) {
+  auto start = std::chrono::steady_clock::now();
+  const char* method = "reflink";
+  long total = 0;
+  int out_fd = -1;
+  int in_fd = open(from.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (in_fd < 0 || fstat(in_fd, &st) < 0) goto err;
   {
-    int dfd = dirfd(fddir);
-    for (struct dirent *dent; (dent = readdir(fddir));) {
-      if (!strcmp(dent->d_name, ".") || !strcmp(dent->d_name, "..")) continue;
-      int fd = strtol(dent->d_name, NULL, 10);
-      if (fd >= minfd && fd != dfd) {
-        if (close(fd) && errno != EBADF) goto error_dir;
-      }
+    mode_t mode = perms == fs::perms::unknown ? st.st_mode & 07777 : (mode_t)(perms & fs::perms::mask);
+    out_fd = open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode);
+    // the mode given to open is masked by umask, and is not applied to an existing file
+    if (out_fd < 0 || fchmod(out_fd, mode) < 0) goto err;
+  }
+  if (ioctl(out_fd, FICLONE, in_fd) == 0) {
+    total = st.st_size;
+  } else {
+    method = "copy_file_range";
+    ssize_t ret;
+    while ((ret = copy_file_range(in_fd, nullptr, out_fd, nullptr, 1l << 30, 0)) > 0) total += ret;
+    if (ret < 0) {
+      // not supported between these filesystems; nothing is copied yet in this case
+      if (total || (errno != EXDEV && errno != EINVAL && errno != EOPNOTSUPP && errno != ENOSYS)) goto err;
+      method = "sendfile";
+      while ((ret = sendfile(out_fd, in_fd, nullptr, 1l << 30)) > 0) total += ret;
+      if (ret < 0) goto err;
     }
   }
-  closedir(fddir);
-  return 0;
-
-error_dir:
-  closedir(fddir);
-error:
-  return -1;
+  if (close(out_fd) < 0) {
+    out_fd = -1;
+    goto err;
+  }
+  close(in_fd);
+  {
+    long usec = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    transfer_files++;
+    transfer_bytes += total;
+    transfer_usec += usec;
+    spdlog::debug("Transferred {} bytes {} -> {} by {} in {} us", total, from.c_str(), to.c_str(), method, usec);
+  }
+  return true;
+err:
+  {
+    int saved_errno = errno;
+    if (in_fd >= 0) close(in_fd);
+    if (out_fd >= 0) close(out_fd);
+    errno = saved_errno;
+  }
+  return false;
 }
-#endif // has_include(<linux/close_range.h>)
 
 } // namespace
 
@@ -126,30 +160,6 @@ fs::path InsideBox(const fs::path& box, const fs::path& path) {
   return "/" / path.lexically_relative(box);
 }
 
-bool SpliceProcess(int read_fd, int write_fd, size_t max_size) {
-  pid_t pid = fork();
-  if (pid < 0) return false;
-  if (pid == 0) {
-    pid_t pid2 = fork();
-    if (pid2 < 0) _exit(1);
-    if (pid2 == 0) {
-      dup2(read_fd, 0);
-      dup2(write_fd, 1);
-      CloseFrom(2);
-      while (max_size) {
-        auto ret = splice(0, nullptr, 1, nullptr, std::min(max_size, (size_t)65536), 0);
-        if (ret <= 0) break;
-        max_size -= ret;
-      }
-    }
-    _exit(0);
-  }
-  int status;
-  if (waitpid(pid, &status, 0) < 0) return false;
-  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) return false;
-  return true;
-}
-
 bool MountTmpfs(const fs::path& path, long size_kib) {
   spdlog::debug("Mount tmpfs on {}, size {}", path.c_str(), size_kib);
   bool ret = 0 == mount("tmpfs", path.c_str(), "tmpfs", 0,
@@ -165,6 +175,66 @@ bool Umount(const fs::path& path) {
   return ret;
 }
 
+void UmountAll(const fs::path& path) {
+  std::string prefix = path.lexically_normal().string();
+  if (prefix.empty() || prefix.back() != '/') prefix += '/';
+  std::vector<std::string> mounts;
+  std::ifstream fin("/proc/self/mountinfo");
+  for (std::string line; std::getline(fin, line);) {
+    // the 5th field is the mount point, with space, tab, newline and backslash escaped in octal
+    std::istringstream sin(line);
+    std::string field;
+    for (int i = 0; i < 5; i++) sin >> field;
+    std::string point;
+    for (size_t i = 0; i < field.size(); i++) {
+      if (field[i] == '\\' && i + 3 < field.size()) {
+        point += (char)std::stoi(field.substr(i + 1, 3), nullptr, 8);
+        i += 3;
+      } else {
+        point += field[i];
+      }
+    }
+    if (point.compare(0, prefix.size(), prefix) == 0) mounts.push_back(point);
+  }
+  // innermost first
+  std::sort(mounts.begin(), mounts.end(), std::greater<>());
+  for (auto& point : mounts) {
+    spdlog::info("Unmounting leaked mount {}", point);
+    if (umount2(point.c_str(), MNT_DETACH) < 0) {
+      spdlog::warn("Failed unmounting {}: {}", point, strerror(errno));
+    }
+  }
+}
+
+bool UmountIfMounted(const fs::path& path) {
+  if (umount2(path.c_str(), UMOUNT_NOFOLLOW) == 0) {
+    spdlog::debug("Umount {}", path.c_str());
+    return true;
+  }
+  if (errno != EINVAL && errno != ENOENT) {
+    spdlog::warn("Failed unmounting {}: {}", path.c_str(), strerror(errno));
+  }
+  return false;
+}
+
+bool BindMount(const fs::path& source, const fs::path& target, bool read_only) {
+  spdlog::debug("Bind mount {} -> {}", source.c_str(), target.c_str());
+  int fd = open(target.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0444);
+  if (fd < 0 || close(fd) < 0) goto err;
+  if (mount(source.c_str(), target.c_str(), nullptr, MS_BIND, nullptr) < 0) goto err;
+  // the read-only flag can only be applied by a remount
+  if (read_only && mount(nullptr, target.c_str(), nullptr, MS_BIND | MS_REMOUNT | MS_RDONLY | MS_NOSUID | MS_NODEV, nullptr) < 0) {
+    int err = errno;
+    umount(target.c_str());
+    errno = err;
+    goto err;
+  }
+  return true;
+err:
+  spdlog::warn("Failed bind mounting {} -> {}: {}", source.c_str(), target.c_str(), strerror(errno));
+  return false;
+}
+
 bool CreateDirs(const fs::path& path, fs::perms perms) {
   spdlog::debug("Create directories {}", path.c_str());
   std::error_code ec;
@@ -190,15 +260,34 @@ err:
   return false;
 }
 
+long DiskUsage(const fs::path& path) {
+  struct stat st;
+  if (lstat(path.c_str(), &st) < 0) return 0;
+  long ret = st.st_blocks * 512;
+  if (!S_ISDIR(st.st_mode)) return ret;
+  std::set<std::pair<dev_t, ino_t>> linked;
+  std::error_code ec;
+  for (auto it = fs::recursive_directory_iterator(path, ec); !ec && it != fs::recursive_directory_iterator();
+       it.increment(ec)) {
+    if (lstat(it->path().c_str(), &st) < 0) continue;
+    if (!S_ISDIR(st.st_mode) && st.st_nlink > 1 && !linked.insert({st.st_dev, st.st_ino}).second) continue;
+    ret += st.st_blocks * 512;
+  }
+  return ret;
+}
+
 bool Move(const fs::path& from, const fs::path& to, fs::perms perms) {
   spdlog::debug("Move file {} -> {}", from.c_str(), to.c_str());
   std::error_code ec;
   fs::rename(from, to, ec);
   if (ec) {
     if (ec.value() != EXDEV) goto err;
-    fs::copy_file(from, to, fs::copy_options::overwrite_existing, ec);
-    if (ec) goto err;
+    if (!TransferFile(from, to, perms)) {
+      ec.assign(errno, std::generic_category());
+      goto err;
+    }
     fs::remove(from, ec);
+    return true;
   }
   if (perms == fs::perms::unknown) return true;
   fs::permissions(to, perms, ec);
@@ -211,14 +300,25 @@ err:
 
 bool Copy(const fs::path& from, const fs::path& to, fs::perms perms) {
   spdlog::debug("Copy file {} -> {}", from.c_str(), to.c_str());
+  if (!TransferFile(from, to, perms)) {
+    spdlog::warn("Failed copying {} -> {}: {}", from.c_str(), to.c_str(), strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+bool LinkOrCopy(const fs::path& from, const fs::path& to) {
+  spdlog::debug("Link file {} -> {}", from.c_str(), to.c_str());
   std::error_code ec;
-  fs::copy_file(from, to, fs::copy_options::overwrite_existing, ec);
-  if (ec) goto err;
-  if (perms == fs::perms::unknown) return true;
-  fs::permissions(to, perms, ec);
-  if (ec) goto err;
+  fs::create_hard_link(from, to, ec);
+  if (ec.value() == EXDEV) return Copy(from, to, fs::status(from).permissions());
+  if (ec) {
+    spdlog::warn("Failed linking {} -> {}: {}", from.c_str(), to.c_str(), strerror(ec.value()));
+    return false;
+  }
   return true;
-err:
-  spdlog::warn("Failed copying {} -> {}: {}", from.c_str(), to.c_str(), strerror(ec.value()));
-  return false;
+}
+
+FileTransferStats GetFileTransferStats() {
+  return {transfer_files, transfer_bytes, transfer_usec};
 }
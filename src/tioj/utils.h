@@ -16,15 +16,30 @@ constexpr fs::perms kPerm666 =
 
 fs::path InsideBox(const fs::path& box, const fs::path& path);
 
-bool SpliceProcess(int read_fd, int write_fd, size_t max_size = std::numeric_limits<size_t>::max());
-
 bool MountTmpfs(const fs::path&, long size_kib);
 bool Umount(const fs::path&);
+// lazily unmount everything mounted under the directory (not including itself)
+void UmountAll(const fs::path&);
+// no warning if the path is not a mount point
+bool UmountIfMounted(const fs::path&);
+// expose the file at source on target (created if not exist) by a bind mount
+bool BindMount(const fs::path& source, const fs::path& target, bool read_only = true);
 bool CreateDirs(const fs::path&, fs::perms = fs::perms::unknown);
 bool RemoveAll(const fs::path&);
+// allocated size in bytes, including everything under a directory (files with several links
+//  inside are counted once); only metadata is read
+long DiskUsage(const fs::path&);
 
 // These functions resolve symlinks; Move allows cross-device move
 bool Move(const fs::path& from, const fs::path& to, fs::perms = fs::perms::unknown);
 bool Copy(const fs::path& from, const fs::path& to, fs::perms = fs::perms::unknown);
+// hard link, or copy if not on the same filesystem
+bool LinkOrCopy(const fs::path& from, const fs::path& to);
+
+// accumulated amount of file content copied by the functions above (renames and links excluded)
+struct FileTransferStats {
+  long files, bytes, usec;
+};
+FileTransferStats GetFileTransferStats();
 
 #endif  // TIOJ_UTILS_H_
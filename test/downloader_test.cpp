@@ -0,0 +1,257 @@
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <fstream>
+#include <thread>
+#include <gtest/gtest.h>
+#include <zstd.h>
+#include <httplib.h>
+#include <openssl/evp.h>
+
+#include "downloader.h"
+#include "utils.h"
+
+namespace {
+
+std::string Content(int id) {
+  std::string ret((id % 3) * (1 << 20) + id * 1000, '\0');
+  for (size_t i = 0; i < ret.size(); i++) ret[i] = "0123456789\n"[(i * 7 + id) % 11];
+  return ret;
+}
+
+std::string Compress(const std::string& str) {
+  std::string ret(ZSTD_compressBound(str.size()), '\0');
+  ret.resize(ZSTD_compress(ret.data(), ret.size(), str.data(), str.size(), 1));
+  return ret;
+}
+
+std::string Sha256(const std::string& str) {
+  unsigned char digest[EVP_MAX_MD_SIZE];
+  unsigned int len = 0;
+  EVP_Digest(str.data(), str.size(), digest, &len, EVP_sha256(), nullptr);
+  std::string ret;
+  for (unsigned int i = 0; i < len; i++) {
+    char buf[3];
+    snprintf(buf, sizeof(buf), "%02x", digest[i]);
+    ret += buf;
+  }
+  return ret;
+}
+
+// Stands for the /fetch/testdata endpoint of the TIOJ server; odd ids are compressed, and
+//  id 999 is a truncated compressed file
+// With drop_after set, each response is cut off (the connection dropped) after that many bytes
+// The content depends on version, which is sent as the ETag; with update set, it is incremented
+//  after the next response
+class StandInServer {
+  httplib::Server svr_;
+  std::thread thread_;
+  int port_;
+ public:
+  std::atomic_int inflight = 0, max_inflight = 0;
+  std::atomic_size_t drop_after = 0;
+  std::atomic_int range_requests = 0;
+  std::atomic_int version = 0;
+  std::atomic_bool update = false;
+
+  StandInServer() {
+    svr_.Get("/fetch/testdata", [this](const httplib::Request& req, httplib::Response& res) {
+      int now = ++inflight;
+      for (int prev = max_inflight; prev < now && !max_inflight.compare_exchange_weak(prev, now);) {}
+      // long enough for the transfers to overlap
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      int id = std::stoi(req.get_param_value("tid"));
+      int ver = version;
+      std::string content = Content(id * 2 + req.has_param("input") + ver * 1000);
+      if (id == 999) {
+        content = Compress(content);
+        content.resize(content.size() / 2);
+      } else if (id % 2) {
+        content = Compress(content);
+      }
+      if (req.ranges.size()) range_requests++;
+      res.set_header("ETag", "\"" + std::to_string(ver) + "\"");
+      if (update.exchange(false)) version++;
+      if (!drop_after) {
+        res.set_content(content, "application/octet-stream");
+      } else {
+        // ranges are applied by httplib through the offset
+        auto data = std::make_shared<std::string>(std::move(content));
+        auto sent = std::make_shared<size_t>(0);
+        res.set_content_provider(data->size(), "application/octet-stream",
+            [this, data, sent](size_t offset, size_t length, httplib::DataSink& sink) {
+              size_t len = std::min({length, drop_after - *sent, (size_t)65536});
+              if (!len) return false;
+              sink.write(data->data() + offset, len);
+              *sent += len;
+              return true;
+            });
+      }
+      inflight--;
+    });
+    port_ = svr_.bind_to_any_port("127.0.0.1");
+    thread_ = std::thread([this]() { svr_.listen_after_bind(); });
+  }
+  ~StandInServer() {
+    svr_.stop();
+    thread_.join();
+  }
+  std::string Url() const { return "http://127.0.0.1:" + std::to_string(port_); }
+};
+
+std::vector<Downloader::Item> Items(const fs::path& dir, const std::vector<int>& ids) {
+  std::vector<Downloader::Item> items;
+  for (int id : ids) {
+    items.push_back({"/fetch/testdata", {{"tid", std::to_string(id)}, {"input", ""}},
+                     dir / (std::to_string(id) + ".in"), id % 2 == 1});
+    items.push_back({"/fetch/testdata", {{"tid", std::to_string(id)}},
+                     dir / (std::to_string(id) + ".out"), id % 2 == 1});
+  }
+  return items;
+}
+
+} // namespace
+
+TEST(Downloader, Parallel) {
+  TempDirectory tmp("/tmp/downloader_test_");
+  ASSERT_FALSE(tmp.Path().empty());
+  fs::path dir = tmp.Path();
+  StandInServer server;
+  std::vector<int> ids;
+  for (int i = 0; i < 20; i++) ids.push_back(i);
+  Downloader downloader(server.Url(), 4);
+  std::atomic_size_t done = 0;
+  ASSERT_TRUE(downloader.Run(Items(dir, ids), [&](size_t) { done++; }));
+  ASSERT_EQ(done, ids.size() * 2);
+  size_t total = 0;
+  for (int id : ids) {
+    ASSERT_EQ(ReadFile(dir / (std::to_string(id) + ".in")), Content(id * 2 + 1));
+    ASSERT_EQ(ReadFile(dir / (std::to_string(id) + ".out")), Content(id * 2));
+    total += Content(id * 2 + 1).size() + Content(id * 2).size();
+  }
+  auto stats = downloader.GetStats();
+  ASSERT_EQ(stats.files, ids.size() * 2);
+  ASSERT_EQ(stats.written_bytes, total);
+  ASSERT_LT(stats.received_bytes, total); // some are compressed
+  ASSERT_GT(server.max_inflight, 1);
+  ASSERT_LE(server.max_inflight, 4);
+}
+
+TEST(Downloader, Truncated) {
+  TempDirectory tmp("/tmp/downloader_test_");
+  ASSERT_FALSE(tmp.Path().empty());
+  fs::path dir = tmp.Path();
+  StandInServer server;
+  ASSERT_FALSE(Downloader(server.Url(), 2).Run(Items(dir, {1, 999, 3})));
+}
+
+TEST(Downloader, Resume) {
+  TempDirectory tmp("/tmp/downloader_test_");
+  ASSERT_FALSE(tmp.Path().empty());
+  fs::path dir = tmp.Path();
+  StandInServer server;
+  // the larger files need several connections each, and would never finish if restarted; the
+  //  compressed ones (a few hundred bytes) are resumed in the middle of their zstd frames
+  for (auto [drop_after, ids] : {std::pair<size_t, std::vector<int>>{300000, {2, 4}}, {64, {1, 7}}}) {
+    server.drop_after = drop_after;
+    server.range_requests = 0;
+    Downloader downloader(server.Url(), 2);
+    ASSERT_TRUE(downloader.Run(Items(dir, ids)));
+    size_t total = 0, transferred = 0;
+    for (int id : ids) {
+      ASSERT_EQ(ReadFile(dir / (std::to_string(id) + ".in")), Content(id * 2 + 1));
+      ASSERT_EQ(ReadFile(dir / (std::to_string(id) + ".out")), Content(id * 2));
+      for (int i : {id * 2, id * 2 + 1}) {
+        total += Content(i).size();
+        transferred += id % 2 ? Compress(Content(i)).size() : Content(i).size();
+      }
+    }
+    ASSERT_GT(server.range_requests, 0);
+    ASSERT_EQ(downloader.GetStats().written_bytes, total);
+    // nothing received twice
+    ASSERT_EQ(downloader.GetStats().received_bytes, transferred);
+  }
+}
+
+TEST(Downloader, ResumeUpdated) {
+  TempDirectory tmp("/tmp/downloader_test_");
+  ASSERT_FALSE(tmp.Path().empty());
+  fs::path dir = tmp.Path();
+  StandInServer server;
+  server.drop_after = 300000;
+  server.update = true;
+  // the file is updated after the first part is received; the next part must not be appended
+  ASSERT_TRUE(Downloader(server.Url(), 1).Run(Items(dir, {2})));
+  ASSERT_EQ(ReadFile(dir / "2.in"), Content(1005));
+  ASSERT_EQ(ReadFile(dir / "2.out"), Content(1004));
+}
+
+TEST(Downloader, HashAndKeepCompressed) {
+  TempDirectory tmp("/tmp/downloader_test_");
+  ASSERT_FALSE(tmp.Path().empty());
+  fs::path dir = tmp.Path();
+  StandInServer server;
+  auto items = Items(dir, {1, 2});
+  items[0].keep_compressed = true;
+  Downloader downloader(server.Url(), 2);
+  ASSERT_TRUE(downloader.Run(items));
+  ASSERT_EQ(ReadFile(dir / "1.in"), Compress(Content(3)));
+  ASSERT_EQ(ReadFile(dir / "1.out"), Content(2));
+  ASSERT_EQ(downloader.Hash(0), Sha256(Content(3)));
+  ASSERT_EQ(downloader.Hash(1), Sha256(Content(2)));
+  ASSERT_EQ(downloader.Hash(2), Sha256(Content(5)));
+  // a file in the way is replaced, not written through
+  std::ofstream(dir / "other") << "other";
+  fs::remove(dir / "2.out");
+  fs::create_hard_link(dir / "other", dir / "2.out");
+  ASSERT_TRUE(downloader.Run(Items(dir, {2})));
+  ASSERT_EQ(ReadFile(dir / "2.out"), Content(4));
+  ASSERT_EQ(ReadFile(dir / "other"), "other");
+}
+
+TEST(Downloader, DecompressFile) {
+  TempDirectory tmp("/tmp/downloader_test_");
+  ASSERT_FALSE(tmp.Path().empty());
+  fs::path dir = tmp.Path();
+  // a multiple of the buffer size, so that the frame ends right at a buffer boundary
+  std::string content = Content(5);
+  content.resize(2 << 20);
+  std::ofstream(dir / "a.zst") << Compress(content);
+  ASSERT_TRUE(DecompressFile(dir / "a.zst", dir / "a"));
+  ASSERT_EQ(ReadFile(dir / "a"), content);
+  // a truncated file leaves the destination alone
+  std::string truncated = Compress(Content(4));
+  truncated.resize(truncated.size() / 2);
+  std::ofstream(dir / "b.zst") << truncated;
+  ASSERT_FALSE(DecompressFile(dir / "b.zst", dir / "a"));
+  ASSERT_EQ(ReadFile(dir / "a"), content);
+  ASSERT_FALSE(fs::exists(dir / "a.tmp"));
+}
+
+TEST(TransferRegistry, Share) {
+  TransferRegistry registry;
+  ASSERT_EQ(registry.TryBegin(1, 100), TransferRegistry::State::OWNER);
+  ASSERT_EQ(registry.TryBegin(1, 100), TransferRegistry::State::IN_FLIGHT);
+  ASSERT_EQ(registry.TryBegin(2, 100), TransferRegistry::State::OWNER);
+  std::atomic_bool ended = false;
+  std::thread waiter([&]() {
+    registry.Wait(1);
+    ASSERT_TRUE(ended);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  ended = true;
+  registry.End(1, 100, true);
+  waiter.join();
+  ASSERT_EQ(registry.TryBegin(1, 100), TransferRegistry::State::DONE);
+  // a newer version is transferred again
+  ASSERT_EQ(registry.TryBegin(1, 101), TransferRegistry::State::OWNER);
+  registry.End(1, 101, true);
+  // and so is a removed one
+  registry.Forget(1);
+  ASSERT_EQ(registry.TryBegin(1, 101), TransferRegistry::State::OWNER);
+  registry.End(1, 101, true);
+  // a failed transfer is left to the next requester
+  registry.End(2, 100, false);
+  registry.Wait(2);
+  ASSERT_EQ(registry.TryBegin(2, 100), TransferRegistry::State::OWNER);
+}
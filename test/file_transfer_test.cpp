@@ -0,0 +1,42 @@
+#include <fstream>
+#include <gtest/gtest.h>
+
+// the internal header
+#include <utils.h>
+// test/utils.h
+#include "utils.h"
+
+TEST(FileTransfer, Copy) {
+  TempDirectory tmp("/tmp/file_transfer_test_");
+  ASSERT_FALSE(tmp.Path().empty());
+  fs::path dir = tmp.Path();
+  std::string content(3 << 20, 'x');
+  std::ofstream(dir / "src") << content;
+  fs::permissions(dir / "src", fs::perms::owner_read | fs::perms::owner_write | fs::perms::owner_exec);
+  // overwrite a longer file; the final mode is not subject to umask
+  std::ofstream(dir / "dst") << content << content;
+  auto before = GetFileTransferStats();
+  ASSERT_TRUE(Copy(dir / "src", dir / "dst", kPerm666));
+  ASSERT_EQ(ReadFile(dir / "dst"), content);
+  ASSERT_EQ(Mode(dir / "dst"), 0666u);
+  // keep the mode of the source
+  ASSERT_TRUE(Copy(dir / "src", dir / "dst2"));
+  ASSERT_EQ(Mode(dir / "dst2"), 0700u);
+  auto after = GetFileTransferStats();
+  ASSERT_EQ(after.files - before.files, 2);
+  ASSERT_EQ(after.bytes - before.bytes, 2 * (long)content.size());
+  ASSERT_FALSE(Copy(dir / "nonexistent", dir / "dst3"));
+  ASSERT_FALSE(fs::exists(dir / "dst3"));
+}
+
+TEST(FileTransfer, MoveAcrossFilesystems) {
+  TempDirectory tmp("/dev/shm/file_transfer_test_"), tmp2("/tmp/file_transfer_test_");
+  if (tmp.Path().empty()) GTEST_SKIP() << "/dev/shm not available";
+  ASSERT_FALSE(tmp2.Path().empty());
+  fs::path dir = tmp.Path(), dir2 = tmp2.Path();
+  std::ofstream(dir / "src") << "content";
+  ASSERT_TRUE(Move(dir / "src", dir2 / "dst", kPerm666));
+  ASSERT_FALSE(fs::exists(dir / "src"));
+  ASSERT_EQ(ReadFile(dir2 / "dst"), "content");
+  ASSERT_EQ(Mode(dir2 / "dst"), 0666u);
+}
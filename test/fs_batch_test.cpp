@@ -0,0 +1,60 @@
+#include <fstream>
+#include <gtest/gtest.h>
+
+#include "fs_batch.h"
+#include "utils.h"
+
+namespace {
+
+void RunBatch(bool use_io_uring) {
+  TempDirectory tmp("/tmp/fs_batch_test_");
+  ASSERT_FALSE(tmp.Path().empty());
+  fs::path dir = tmp.Path();
+  std::ofstream(dir / "src") << "content";
+  {
+    FsBatch batch(use_io_uring);
+    batch.Mkdir(dir / "box", fs::perms::all);
+    batch.Mkdir(dir / "box"); // already exists
+    batch.Mkdir(dir / "box" / "workdir");
+    batch.Create(dir / "box" / "workdir" / "output", fs::perms(0666));
+    batch.Link(dir / "src", dir / "box" / "workdir" / "prog");
+    batch.Symlink(dir / "box", dir / "link");
+    batch.Rename(dir / "src", dir / "box" / "input", fs::perms(0600));
+    batch.Unlink(dir / "nonexistent");
+    size_t failed = batch.Rmdir(dir / "box"); // not empty
+    ASSERT_FALSE(batch.Run());
+    ASSERT_FALSE(batch.Succeeded(failed));
+    ASSERT_TRUE(batch.Succeeded(0));
+  }
+  ASSERT_EQ(Mode(dir / "box"), 0777u);
+  ASSERT_EQ(Mode(dir / "box" / "workdir" / "output"), 0666u);
+  ASSERT_EQ(fs::file_size(dir / "box" / "workdir" / "output"), 0u);
+  ASSERT_EQ(fs::hard_link_count(dir / "box" / "input"), 2u);
+  ASSERT_EQ(Mode(dir / "box" / "input"), 0600u);
+  ASSERT_EQ(fs::read_symlink(dir / "link"), dir / "box");
+  ASSERT_FALSE(fs::exists(dir / "src"));
+  {
+    // more operations than the ring size, in order
+    FsBatch batch(use_io_uring);
+    for (int i = 0; i < 100; i++) batch.Mkdir(dir / "box" / std::to_string(i));
+    for (int i = 0; i < 100; i++) batch.Rmdir(dir / "box" / std::to_string(i));
+    batch.Unlink(dir / "box" / "workdir" / "output");
+    batch.Unlink(dir / "box" / "workdir" / "prog");
+    batch.Rmdir(dir / "box" / "workdir");
+    batch.Unlink(dir / "box" / "input");
+    batch.Rmdir(dir / "box");
+    batch.Unlink(dir / "link");
+    ASSERT_TRUE(batch.Run());
+  }
+  ASSERT_TRUE(fs::is_empty(dir));
+}
+
+} // namespace
+
+TEST(FsBatch, IoUring) {
+  RunBatch(true);
+}
+
+TEST(FsBatch, Fallback) {
+  RunBatch(false);
+}
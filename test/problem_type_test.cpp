@@ -232,6 +232,20 @@ int main(int argc, char**argv){
   RunAndTeardownSubmission(id);
 }
 
+TEST_F(ExampleProblem, SpecjudgeCustomCompilerHeaders) {
+  SetUp(4, 2);
+  AssertVerdictReporter reporter(Verdict::AC);
+  sub.reporter = reporter.GetReporter();
+  // judge headers are found without naming their directory
+  sub.specjudge_compile_args = "/usr/bin/env g++ -std=c++17 -O2 -o $OUTPUT -x c++ $INPUT";
+  long id = SetupSubmission(sub, 1, Compiler::GCC_CPP_17, kTime, true, "int main(){}",
+      SpecjudgeType::SPECJUDGE_OLD, R"(#include "testlib.h"
+#include "nlohmann/json.hpp"
+int main(){ puts("0"); })");
+  sub.specjudge_lang = Compiler::CUSTOM;
+  RunAndTeardownSubmission(id);
+}
+
 TEST_F(ExampleProblem, SkipGroup) {
   SetUp(5, 4, 1);
   sub.skip_group = true;
@@ -0,0 +1,41 @@
+#include <unistd.h>
+#include <sys/socket.h>
+#include <gtest/gtest.h>
+
+#include "sandbox.h"
+
+TEST(Sandbox, RequestRoundTrip) {
+  int sv[2], pipefd[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+  ASSERT_EQ(pipe(pipefd), 0);
+  SandboxOptions opt;
+  opt.boxdir = "/tmp/box";
+  opt.command = {"/prog", "arg"};
+  opt.fd_output = pipefd[1];
+  opt.cpu_set = {1, 3};
+  opt.dirs = std::vector<std::string>(1000, "/usr");
+  ASSERT_TRUE(SendSandboxRequest(sv[0], opt));
+  close(pipefd[1]);
+
+  SandboxOptions recv;
+  ASSERT_TRUE(RecvSandboxRequest(sv[1], recv));
+  ASSERT_EQ(recv.boxdir, opt.boxdir);
+  ASSERT_EQ(recv.command, opt.command);
+  ASSERT_EQ(recv.cpu_set, opt.cpu_set);
+  ASSERT_EQ(recv.dirs, opt.dirs);
+  ASSERT_EQ(recv.fd_input, -1);
+  ASSERT_EQ(recv.fd_error, -1);
+  // the received fd refers to the same pipe
+  ASSERT_NE(recv.fd_output, -1);
+  ASSERT_EQ(write(recv.fd_output, "x", 1), 1);
+  close(recv.fd_output);
+  char c;
+  ASSERT_EQ(read(pipefd[0], &c, 1), 1);
+  ASSERT_EQ(c, 'x');
+
+  // EOF on a closed connection
+  close(sv[0]);
+  ASSERT_FALSE(RecvSandboxRequest(sv[1], recv));
+  close(sv[1]);
+  close(pipefd[0]);
+}
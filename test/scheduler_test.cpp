@@ -0,0 +1,256 @@
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <fstream>
+
+#include "example_problem.h"
+#include "utils.h"
+#include "paths.h"
+#include "td_pool.h"
+
+namespace {
+
+constexpr long kTime = 1670000000;
+using Clock = std::chrono::steady_clock;
+
+// Set a global setting for the rest of the scope; restored even if an assertion returns early
+template <class T>
+class ScopedSetting {
+  T& var_;
+  T orig_;
+ public:
+  ScopedSetting(T& var, T val) : var_(var), orig_(var) { var_ = val; }
+  ~ScopedSetting() { var_ = orig_; }
+};
+
+} // namespace
+
+// A submission pushed while another task is running should be dispatched immediately
+//  if there are free slots, instead of waiting for the running task to finish
+TEST_F(ExampleProblem, EnqueueToDispatchLatency) {
+  SetUp(1, 1, 2);
+  Submission sub2 = sub;
+  // wall time limit is 2 seconds; this occupies one slot until then
+  AssertVerdictReporter reporter(Verdict::TLE);
+  sub.reporter = reporter.GetReporter();
+  std::promise<void> started;
+  sub.reporter.ReportStartCompiling = [&](const Submission&, const SubmissionResult&) {
+    started.set_value();
+  };
+  long id = SetupSubmission(sub, 9, Compiler::GCC_CPP_17, kTime, false, R"(#include <unistd.h>
+int main(){ sleep(10); })");
+
+  AssertVerdictReporter reporter2(Verdict::AC);
+  sub2.reporter = reporter2.GetReporter();
+  Clock::time_point push_time, dispatch_time;
+  sub2.reporter.ReportStartCompiling = [&](const Submission&, const SubmissionResult&) {
+    dispatch_time = Clock::now();
+  };
+  long id2 = SetupSubmission(sub2, 10, Compiler::GCC_CPP_17, kTime, false, R"(#include <cstdio>
+int main(){ int a; scanf("%d",&a);printf("%d",a); })");
+
+  std::thread thr([&]() {
+    started.get_future().wait();
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    push_time = Clock::now();
+    PushSubmission(std::move(sub2));
+  });
+  PushSubmission(std::move(sub));
+  WorkLoop(false);
+  thr.join();
+  TeardownSubmission(id);
+  TeardownSubmission(id2);
+
+  auto latency = std::chrono::duration<double>(dispatch_time - push_time).count();
+  RecordProperty("dispatch_latency_ms", std::to_string(latency * 1000));
+  ASSERT_LT(latency, 0.5);
+}
+
+// Execute boxes staged ahead for a submission should be torn down (including their tmpfs mounts)
+//  once a rejudge cancels it
+TEST_F(ExampleProblem, LookaheadCancelled) {
+  SetUp(1, 4, 1);
+  ScopedSetting lookahead(kLookahead, 2);
+  Submission sub2 = sub;
+  std::promise<void> first_scored;
+  bool scored = false;
+  sub.reporter.ReportScoringResult = [&](const Submission&, const SubmissionResult&, int, int) {
+    if (!scored) first_scored.set_value();
+    scored = true;
+  };
+  sub.reporter.ReportOverallResult = [&](const Submission&, const SubmissionResult&) {
+    ADD_FAILURE() << "Cancelled submission reported";
+  };
+  long id = SetupSubmission(sub, 11, Compiler::GCC_CPP_17, kTime, false, R"(#include <unistd.h>
+int main(){ sleep(10); })");
+
+  AssertVerdictReporter reporter2(Verdict::AC);
+  sub2.reporter = reporter2.GetReporter();
+  long id2 = SetupSubmission(sub2, 11, Compiler::GCC_CPP_17, kTime, false, R"(#include <cstdio>
+int main(){ int a; scanf("%d",&a);printf("%d",a); })");
+
+  std::thread thr([&]() {
+    // the next execute is running and the rest are staged
+    first_scored.get_future().wait();
+    PushSubmission(std::move(sub2));
+  });
+  PushSubmission(std::move(sub));
+  WorkLoop(false);
+  thr.join();
+  TeardownSubmission(id);
+  TeardownSubmission(id2);
+
+  ASSERT_FALSE(fs::exists(SubmissionRunPath(id)));
+  std::ifstream mounts("/proc/self/mounts");
+  std::string line;
+  while (std::getline(mounts, line)) {
+    ASSERT_EQ(line.find(SubmissionRunPath(id).string()), std::string::npos) << line;
+  }
+}
+
+// A running execute of a submission replaced by a rejudge should be killed instead of running
+//  until its time limit
+TEST_F(ExampleProblem, KillCancelled) {
+  SetUp(1, 1, 1);
+  sub.testdata[0].time = 10'000'000;
+  Submission sub2 = sub;
+  std::promise<void> started;
+  sub.reporter.ReportStartCompiling = [&](const Submission&, const SubmissionResult&) {
+    started.set_value();
+  };
+  sub.reporter.ReportOverallResult = [&](const Submission&, const SubmissionResult&) {
+    ADD_FAILURE() << "Cancelled submission reported";
+  };
+  long id = SetupSubmission(sub, 12, Compiler::GCC_CPP_17, kTime, false, R"(#include <unistd.h>
+int main(){ sleep(30); })");
+
+  AssertVerdictReporter reporter2(Verdict::AC);
+  sub2.reporter = reporter2.GetReporter();
+  long id2 = SetupSubmission(sub2, 12, Compiler::GCC_CPP_17, kTime, false, R"(#include <cstdio>
+int main(){ int a; scanf("%d",&a);printf("%d",a); })");
+
+  auto start_time = Clock::now();
+  std::thread thr([&]() {
+    started.get_future().wait();
+    // wait until it is executing
+    std::this_thread::sleep_for(std::chrono::seconds(3));
+    PushSubmission(std::move(sub2));
+  });
+  PushSubmission(std::move(sub));
+  WorkLoop(false);
+  thr.join();
+  TeardownSubmission(id);
+  TeardownSubmission(id2);
+
+  auto elapsed = std::chrono::duration<double>(Clock::now() - start_time).count();
+  RecordProperty("elapsed_ms", std::to_string(elapsed * 1000));
+  ASSERT_LT(elapsed, 9);
+  ASSERT_FALSE(fs::exists(SubmissionRunPath(id)));
+}
+
+// Compilation should not wait for testdata fetches, and each testdata should be executed once
+//  its own fetch is done
+TEST_F(ExampleProblem, FetchTestdata) {
+  SetUp(1, 3, 1);
+  AssertVerdictReporter reporter(Verdict::AC);
+  sub.reporter = reporter.GetReporter();
+  std::promise<void> started;
+  sub.reporter.ReportStartCompiling = [&](const Submission&, const SubmissionResult&) {
+    started.set_value();
+  };
+  std::atomic_bool fetched = false;
+  auto report_scoring = sub.reporter.ReportScoringResult;
+  sub.reporter.ReportScoringResult = [&, report_scoring](
+      const Submission& sub, const SubmissionResult& res, int subtask, int stage) {
+    EXPECT_TRUE(fetched);
+    report_scoring(sub, res, subtask, stage);
+  };
+  std::vector<std::function<void(bool)>> fetches(3);
+  sub.fetch_testdata = [&](const Submission&, int subtask, std::function<void(bool)> done) {
+    fetches[subtask] = std::move(done);
+  };
+  long id = SetupSubmission(sub, 13, Compiler::GCC_CPP_17, kTime, false, R"(#include <cstdio>
+int main(){ int a; scanf("%d",&a);printf("%d",a); })");
+
+  std::thread thr([&]() {
+    started.get_future().wait();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    fetched = true;
+    for (auto& done : fetches) done(true);
+  });
+  PushSubmission(std::move(sub));
+  WorkLoop(false);
+  thr.join();
+  TeardownSubmission(id);
+  ASSERT_TRUE(fetched);
+}
+
+TEST_F(ExampleProblem, FetchTestdataFailed) {
+  SetUp(1, 3, 1);
+  AssertVerdictReporter reporter(Verdict::JE, false, false);
+  sub.reporter = reporter.GetReporter();
+  sub.fetch_testdata = [&](const Submission&, int subtask, std::function<void(bool)> done) {
+    done(subtask != 1);
+  };
+  long id = SetupSubmission(sub, 14, Compiler::GCC_CPP_17, kTime, false, R"(#include <cstdio>
+int main(){ int a; scanf("%d",&a);printf("%d",a); })");
+  PushSubmission(std::move(sub));
+  WorkLoop(false);
+  TeardownSubmission(id);
+}
+
+// While the testdata of a problem is updated for a new submission, an older one keeps judging the
+//  old testdata; as in the server, the links of a position are moved to the new files only once
+//  they are in place
+TEST_F(ExampleProblem, UpdateWhileJudging) {
+  SetUp(1, {{"3\n", "3\n"}}, 2);
+  fs::path input_link = td_path / "input000", answer_link = td_path / "output000";
+  ASSERT_TRUE(RetargetLink(input_link, td_path / "0.in"));
+  ASSERT_TRUE(RetargetLink(answer_link, td_path / "0.out"));
+  sub.testdata[0].input_file = input_link;
+  sub.testdata[0].answer_file = answer_link;
+  Submission sub2 = sub;
+
+  AssertVerdictReporter reporter(Verdict::AC);
+  sub.reporter = reporter.GetReporter();
+  std::promise<void> judged;
+  auto report_overall = sub.reporter.ReportOverallResult;
+  sub.reporter.ReportOverallResult = [&, report_overall](
+      const Submission& sub, const SubmissionResult& res) {
+    report_overall(sub, res);
+    judged.set_value();
+  };
+  long id = SetupSubmission(sub, 15, Compiler::GCC_CPP_17, kTime, false, R"(#include <cstdio>
+#include <unistd.h>
+int main(){ sleep(1); int a; scanf("%d",&a);printf("%d",a); })");
+
+  // the new testdata expects 7
+  AssertVerdictReporter reporter2(Verdict::AC);
+  sub2.reporter = reporter2.GetReporter();
+  std::thread download;
+  sub2.fetch_testdata = [&](const Submission&, int, std::function<void(bool)> done) {
+    download = std::thread([&, done = std::move(done)]() {
+      std::ofstream(td_path / "new.in") << "7\n";
+      std::ofstream(td_path / "new.out") << "7\n";
+      // still downloading while the older submission is judged
+      judged.get_future().wait();
+      bool ok;
+      {
+        auto lck = td_file_lock.Exclusive(problem_id);
+        ok = RetargetLink(input_link, td_path / "new.in") &&
+             RetargetLink(answer_link, td_path / "new.out");
+      }
+      done(ok);
+    });
+  };
+  long id2 = SetupSubmission(sub2, 16, Compiler::GCC_CPP_17, kTime, false, R"(#include <cstdio>
+int main(){ puts("7"); })");
+
+  PushSubmission(std::move(sub));
+  PushSubmission(std::move(sub2));
+  WorkLoop(false);
+  download.join();
+  TeardownSubmission(id);
+  TeardownSubmission(id2);
+}
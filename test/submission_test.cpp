@@ -50,4 +50,14 @@ int main(){ int a; scanf("%d",&a);printf("%d",a); })"},
     ),
     ParamName);
 
+// Testdata are exposed read-only; the program cannot modify the input file
+TEST_F(ExampleProblem, ReadOnlyTestdata) {
+  SetUp(1, 2);
+  AssertVerdictReporter reporter(Verdict::AC);
+  sub.reporter = reporter.GetReporter();
+  long id = SetupSubmission(sub, 5, Compiler::GCC_CPP_17, kTime, false, R"(#include <cstdio>
+int main(){ int a; scanf("%d",&a); if (fopen("input","r+")) a++; printf("%d",a); })");
+  RunAndTeardownSubmission(id);
+}
+
 // TODO: multiple submission rejudge
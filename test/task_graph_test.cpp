@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+
+#include "task_graph.h"
+
+TEST(TaskGraph, RemoveReleasesSuccessors) {
+  TaskGraph graph;
+  uint32_t a = graph.AddNode({TaskType::COMPILE, 0, 0});
+  uint32_t b = graph.AddNode({TaskType::EXECUTE, 0, 0}, 1);
+  uint32_t c = graph.AddNode({TaskType::EXECUTE, 1, 0}, 2);
+  uint32_t d = graph.AddNode({TaskType::SUMMARY, 0, 0});
+  graph.Link(a, b);
+  graph.Link(b, d);
+  graph.Link(a, c);
+  graph.Link(c, d);
+  graph.Freeze();
+
+  std::vector<uint32_t> roots;
+  graph.ForEachRoot([&](uint32_t x) { roots.push_back(x); });
+  ASSERT_EQ(roots, std::vector<uint32_t>{a});
+  ASSERT_EQ(graph[d].indeg, 2);
+
+  std::vector<uint32_t> ready;
+  auto push = [&](uint32_t x) { ready.push_back(x); };
+  graph.Remove(a, push);
+  ASSERT_EQ(ready, (std::vector<uint32_t>{b, c}));
+  graph.Remove(b, push);
+  ASSERT_EQ(ready.size(), 2u);
+  graph.Remove(c, push);
+  ASSERT_EQ(ready.back(), d);
+  graph.Remove(d, push);
+  ASSERT_EQ(graph.Remaining(), 0u);
+}
+
+TEST(TaskGraph, ReadyQueueOrder) {
+  TaskArena arena;
+  uint32_t s1 = arena.Allocate(1, 0, nullptr);
+  uint32_t s2 = arena.Allocate(2, 5, nullptr);
+  uint32_t s3 = arena.Allocate(3, 0, nullptr);
+  for (uint32_t s : {s1, s2, s3}) {
+    arena[s].graph.AddNode({TaskType::EXECUTE, 0, 0}, 1);
+    arena[s].graph.AddNode({TaskType::EXECUTE, 1, 0}, 0);
+    arena[s].graph.Freeze();
+  }
+  ReadyQueue queue;
+  for (uint32_t s : {s3, s1, s2}) {
+    arena[s].graph.ForEachRoot([&](uint32_t x) { queue.push(arena.MakeReady(s, x)); });
+  }
+  // higher priority first, then smaller submission id, then smaller task order
+  std::vector<std::pair<long, uint32_t>> order;
+  while (!queue.empty()) {
+    order.emplace_back(queue.top().submission_internal_id, queue.top().ref.node);
+    queue.pop();
+  }
+  ASSERT_EQ(order, (std::vector<std::pair<long, uint32_t>>{{2, 1}, {2, 0}, {1, 1}, {1, 0}, {3, 1}, {3, 0}}));
+}
+
+TEST(TaskGraph, StaleReference) {
+  TaskArena arena;
+  uint32_t s1 = arena.Allocate(1, 0, nullptr);
+  arena[s1].graph.AddNode({TaskType::SUMMARY, 0, 0});
+  arena[s1].graph.Freeze();
+  ReadyTask task = arena.MakeReady(s1, 0);
+  ASSERT_EQ(arena.Get(task.ref), &arena[s1]);
+  arena.Release(s1);
+  ASSERT_EQ(arena.Get(task.ref), nullptr);
+  // slot is reused with a new generation
+  uint32_t s2 = arena.Allocate(2, 0, nullptr);
+  ASSERT_EQ(s1, s2);
+  ASSERT_EQ(arena[s2].graph.Size(), 0u);
+  ASSERT_EQ(arena.Get(task.ref), nullptr);
+}
@@ -0,0 +1,65 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <gtest/gtest.h>
+
+#include <tioj/paths.h>
+
+TEST(TdFileLock, SharedAndExclusive) {
+  TdFileLock lock;
+  std::atomic_int readers = 0, max_readers = 0;
+  std::atomic_bool writing = false;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; i++) {
+    threads.emplace_back([&]() {
+      auto lck = lock.Shared(1);
+      EXPECT_FALSE(writing);
+      int now = ++readers;
+      for (int prev = max_readers; prev < now && !max_readers.compare_exchange_weak(prev, now);) {}
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      readers--;
+    });
+  }
+  threads.emplace_back([&]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    auto lck = lock.Exclusive(1);
+    writing = true;
+    EXPECT_EQ(readers, 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    writing = false;
+  });
+  {
+    // other problems are not affected
+    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    auto lck = lock.Exclusive(2);
+    ASSERT_EQ(lock.Size(), 2u);
+  }
+  for (auto& thread : threads) thread.join();
+  ASSERT_GT(max_readers, 1);
+  // entries are freed once released
+  ASSERT_EQ(lock.Size(), 0u);
+}
+
+// readers arriving while a writer waits go after it
+TEST(TdFileLock, WriterFirst) {
+  TdFileLock lock;
+  std::atomic_bool written = false;
+  std::thread writer, reader;
+  {
+    auto lck = lock.Shared(1);
+    writer = std::thread([&]() {
+      auto lck = lock.Exclusive(1);
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      written = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    reader = std::thread([&]() {
+      auto lck = lock.Shared(1);
+      EXPECT_TRUE(written);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  writer.join();
+  reader.join();
+  ASSERT_EQ(lock.Size(), 0u);
+}
@@ -0,0 +1,96 @@
+#include <fstream>
+#include <gtest/gtest.h>
+
+// the internal header
+#include <utils.h>
+
+#include "td_pool.h"
+// test/utils.h
+#include "utils.h"
+
+namespace {
+
+// 64 KiB each, so that every blob takes the same amount of disk
+void WriteBlob(const fs::path& path, char ch) {
+  fs::create_directories(path.parent_path());
+  std::ofstream(path) << std::string(65536, ch);
+}
+
+} // namespace
+
+TEST(TdPool, LinkAndSweepBlobs) {
+  TempDirectory tmp("/tmp/td_pool_test_");
+  ASSERT_FALSE(tmp.Path().empty());
+  fs::path dir = tmp.Path(), blobs = dir / "blobs";
+  // the first download becomes the blob; the second one with the same content is replaced by it
+  WriteBlob(dir / "a", 'a');
+  WriteBlob(dir / "b", 'a');
+  ASSERT_TRUE(LinkBlob(dir / "a", blobs / "aa"));
+  ASSERT_TRUE(LinkBlob(dir / "b", blobs / "aa"));
+  ASSERT_TRUE(fs::equivalent(dir / "a", dir / "b"));
+  ASSERT_EQ(fs::hard_link_count(blobs / "aa"), 3u);
+  ASSERT_FALSE(fs::exists(dir / "b.link"));
+  ASSERT_TRUE(AdoptBlob(blobs / "aa", dir / "c"));
+  ASSERT_FALSE(AdoptBlob(blobs / "bb", dir / "d"));
+  // a blob stays as long as any file uses it
+  fs::remove(dir / "a");
+  fs::remove(dir / "b");
+  SweepBlobs(blobs);
+  ASSERT_TRUE(fs::exists(blobs / "aa"));
+  fs::remove(dir / "c");
+  SweepBlobs(blobs);
+  ASSERT_FALSE(fs::exists(blobs / "aa"));
+}
+
+TEST(TdPool, EvictProblems) {
+  TempDirectory tmp("/tmp/td_pool_test_");
+  ASSERT_FALSE(tmp.Path().empty());
+  fs::path dir = tmp.Path(), blobs = dir / "blobs";
+  auto Problem = [&](int problem_id) { return dir / std::to_string(problem_id); };
+  // problem 1 shares a blob with problem 3
+  WriteBlob(blobs / "shared", 's');
+  for (auto [problem_id, blob, ch] : {std::tuple{1, "only1", '1'}, {2, "only2", '2'}, {3, "only3", '3'}}) {
+    WriteBlob(blobs / blob, ch);
+    fs::create_directories(Problem(problem_id));
+    ASSERT_TRUE(AdoptBlob(blobs / blob, Problem(problem_id) / "1.in"));
+    if (problem_id != 2) {
+      ASSERT_TRUE(AdoptBlob(blobs / "shared", Problem(problem_id) / "1.out"));
+    }
+  }
+  ProblemRefs refs;
+  refs.Ref(2);
+  std::vector<int> removed;
+  auto usage = [&]() { return DiskUsage(dir); };
+  auto remove = [&](int problem_id) {
+    removed.push_back(problem_id);
+    fs::remove_all(Problem(problem_id));
+  };
+  // (last used, problem id); problem 2 is the least recently used but referenced
+  std::vector<std::pair<long, int>> order{{30, 3}, {10, 2}, {20, 1}};
+  // freeing the blob only used by problem 1 is enough
+  long budget = usage() - 1;
+  ASSERT_EQ(EvictProblems(order, budget, refs, blobs, usage, remove), std::vector<int>{1});
+  ASSERT_EQ(removed, std::vector<int>{1});
+  ASSERT_LE(usage(), budget);
+  ASSERT_FALSE(fs::exists(blobs / "only1"));
+  for (auto blob : {"shared", "only2", "only3"}) ASSERT_TRUE(fs::exists(blobs / blob));
+  ASSERT_TRUE(fs::exists(Problem(2) / "1.in"));
+  ASSERT_TRUE(fs::exists(Problem(3) / "1.out"));
+  // within the budget, nothing is evicted
+  ASSERT_TRUE(EvictProblems(order, usage(), refs, blobs, usage, remove).empty());
+  // nor is a referenced problem even if nothing else is left
+  ASSERT_EQ(EvictProblems({{10, 2}, {30, 3}}, 0, refs, blobs, usage, remove), std::vector<int>{3});
+  ASSERT_TRUE(fs::exists(blobs / "only2"));
+  ASSERT_FALSE(fs::exists(blobs / "shared"));
+  // once released, it becomes idle and can be evicted
+  ASSERT_TRUE(refs.Idle(0).empty());
+  refs.Unref(2);
+  ASSERT_EQ(refs.Idle(0), std::vector<int>{2});
+  ASSERT_TRUE(refs.Idle(3600).empty());
+  ASSERT_EQ(EvictProblems({{10, 2}}, 0, refs, blobs, usage, remove), std::vector<int>{2});
+  ASSERT_TRUE(refs.Idle(0).empty());
+  // the eviction has ended, so referencing does not block
+  refs.Ref(2);
+  ASSERT_FALSE(refs.TryBeginEvict(2));
+  refs.Unref(2);
+}
@@ -0,0 +1,15 @@
+#include <atomic>
+#include <gtest/gtest.h>
+
+#include "thread_pool.h"
+
+TEST(ThreadPool, RunAllJobs) {
+  std::atomic_int count = 0;
+  {
+    ThreadPool pool(3);
+    ASSERT_EQ(pool.NumThreads(), 3u);
+    for (int i = 0; i < 100; i++) pool.Submit([&count]() { count++; });
+  }
+  // the destructor waits for submitted jobs
+  ASSERT_EQ(count, 100);
+}
@@ -0,0 +1,62 @@
+#include <fstream>
+#include <sys/statfs.h>
+#include <gtest/gtest.h>
+
+// the internal header
+#include <utils.h>
+
+#include "tmpfs_pool.h"
+// test/utils.h
+#include "utils.h"
+
+namespace {
+
+long SizeKiB(const fs::path& path) {
+  struct statfs st;
+  if (statfs(path.c_str(), &st) < 0) return -1;
+  return st.f_blocks * st.f_bsize / 1024;
+}
+
+// unmounts what is left under root before it is removed, even if an assertion fails
+class UmountGuard {
+  fs::path root_;
+ public:
+  explicit UmountGuard(const fs::path& root) : root_(root) {}
+  ~UmountGuard() { UmountAll(root_); }
+};
+
+} // namespace
+
+TEST(TmpfsPool, Recycle) {
+  TempDirectory tmp("/tmp/tmpfs_pool_test_");
+  ASSERT_FALSE(tmp.Path().empty());
+  fs::path root = tmp.Path();
+  UmountGuard guard(root);
+  {
+    TmpfsPool pool(root);
+    pool.Fill(2);
+    ASSERT_EQ(pool.Size(), 2u);
+    fs::path path = pool.Acquire(1024);
+    ASSERT_FALSE(path.empty());
+    ASSERT_EQ(SizeKiB(path), 1024);
+    std::ofstream(path / "file") << "data";
+    pool.Release(path, 2);
+    ASSERT_EQ(pool.Size(), 2u);
+
+    // reused with a new size and wiped
+    path = pool.Acquire(2048);
+    ASSERT_EQ(SizeKiB(path), 2048);
+    ASSERT_TRUE(fs::is_empty(path));
+    // shrink
+    pool.Release(path, 0);
+    ASSERT_EQ(pool.Size(), 1u);
+    ASSERT_FALSE(fs::exists(path));
+  }
+  // the remaining one is reclaimed by the next pool
+  TmpfsPool pool(root);
+  ASSERT_EQ(pool.Size(), 0u);
+  std::ifstream fin("/proc/self/mountinfo");
+  for (std::string line; std::getline(fin, line);) {
+    ASSERT_EQ(line.find(root.string()), std::string::npos) << line;
+  }
+}
@@ -0,0 +1,57 @@
+#include <chrono>
+#include <fstream>
+#include <thread>
+#include <gtest/gtest.h>
+
+#include "trash.h"
+// test/utils.h
+#include "utils.h"
+
+namespace {
+
+void WaitEmpty(Trash& trash) {
+  for (int i = 0; i < 500 && trash.GetBacklog().entries; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+}
+
+} // namespace
+
+TEST(Trash, Collect) {
+  TempDirectory tmp("/tmp/trash_test_");
+  ASSERT_FALSE(tmp.Path().empty());
+  fs::path root = tmp.Path();
+  fs::create_directories(root / "trash");
+  // left by a previous run
+  std::ofstream(root / "trash" / "3") << "old";
+  {
+    Trash trash(root / "trash", 1 << 20);
+    for (int i = 0; i < 10; i++) {
+      fs::path box = root / ("box" + std::to_string(i));
+      fs::create_directories(box / "workdir");
+      std::ofstream(box / "workdir" / "output") << std::string(100000, 'a');
+      trash.Discard(box);
+      ASSERT_FALSE(fs::exists(box));
+    }
+    // nonexistent paths are ignored
+    trash.Discard(root / "nonexistent");
+    WaitEmpty(trash);
+    ASSERT_EQ(trash.GetBacklog().entries, 0u);
+    ASSERT_EQ(trash.GetBacklog().bytes, 0);
+    ASSERT_TRUE(fs::is_empty(root / "trash"));
+  }
+}
+
+TEST(Trash, OtherFilesystem) {
+  TempDirectory root_tmp("/tmp/trash_test_");
+  ASSERT_FALSE(root_tmp.Path().empty());
+  TempDirectory dir_tmp("/dev/shm/trash_test_");
+  if (dir_tmp.Path().empty()) GTEST_SKIP() << "/dev/shm not available";
+  fs::path root = root_tmp.Path(), dir = dir_tmp.Path();
+  Trash trash(root, 1 << 20);
+  std::ofstream(dir / "file") << "data";
+  // removed in place
+  trash.Discard(dir);
+  ASSERT_FALSE(fs::exists(dir));
+  ASSERT_EQ(trash.GetBacklog().entries, 0u);
+}
@@ -1,6 +1,9 @@
 #include "utils.h"
 
+#include <stdlib.h>
+#include <sys/stat.h>
 #include <fstream>
+#include <sstream>
 #include <filesystem>
 #include <tioj/paths.h>
 
@@ -37,3 +40,26 @@ long SetupSubmission(
 void TeardownSubmission(long id) {
   fs::remove_all(SubmissionCodePath(id));
 }
+
+TempDirectory::TempDirectory(const std::string& prefix) {
+  std::string path = prefix + "XXXXXX";
+  if (mkdtemp(path.data())) path_ = path;
+}
+
+TempDirectory::~TempDirectory() {
+  std::error_code ec;
+  if (!path_.empty()) fs::remove_all(path_, ec);
+}
+
+std::string ReadFile(const fs::path& path) {
+  std::ifstream fin(path);
+  std::stringstream ss;
+  ss << fin.rdbuf();
+  return ss.str();
+}
+
+mode_t Mode(const fs::path& path) {
+  struct stat st;
+  if (lstat(path.c_str(), &st) < 0) return -1;
+  return st.st_mode & 07777;
+}
@@ -1,6 +1,8 @@
 #ifndef TEST_UTILS_H_
 #define TEST_UTILS_H_
 
+#include <sys/types.h>
+#include <filesystem>
 #include <gtest/gtest.h>
 #include <tioj/utils.h>
 #include <tioj/submission.h>
@@ -61,4 +63,17 @@ long SetupSubmission(
 
 void TeardownSubmission(long id);
 
+class TempDirectory { // RAII tempdir
+  std::filesystem::path path_;
+ public:
+  // made by mkdtemp from prefix + "XXXXXX"; Path() is empty if that fails
+  explicit TempDirectory(const std::string& prefix);
+  ~TempDirectory();
+  const std::filesystem::path& Path() const { return path_; }
+};
+
+std::string ReadFile(const std::filesystem::path&);
+// permission bits (of a symlink itself); -1 if it does not exist
+mode_t Mode(const std::filesystem::path&);
+
 #endif // TEST_UTILS_H_